@@ -0,0 +1,158 @@
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <iostream>
+#include <limits>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <boost/lexical_cast.hpp>
+
+#include "GWAS.hxx"
+#include "Scanner.hxx"
+
+//
+// Times the parsing and tokenizing paths of the loader against the ones they replaced, on synthetic data.
+//
+
+/**
+ * The parser the loader used before try_parse: a std::string per cell, and a thrown and caught exception for every
+ * cell that does not parse.
+ */
+template<typename T>
+auto lexical_parser(const std::string& v) -> T {
+    try {
+        return boost::lexical_cast<T>(v);
+    }
+    catch(const boost::bad_lexical_cast&){
+        return std::numeric_limits<T>::quiet_NaN();
+    }
+}
+
+/**
+ * The tokenizer the loader used before for_each_cell: an std::istringstream per line and a std::string per cell.
+ */
+std::vector<std::string> getTokens(std::string& line){
+    std::vector<std::string> tokens;
+
+    std::istringstream iss(line);
+    std::string token;
+    while (std::getline(iss, token, '\t'))
+        tokens.push_back(token);
+    return tokens;
+}
+
+/**
+ * @return the milliseconds taken by f
+ */
+template<typename F>
+double time_ms(F f)
+{
+    auto start = std::chrono::steady_clock::now();
+    f();
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+/**
+ * A column shaped like CHR_POS or OR or BETA in the catalog, with most cells empty or not a number.
+ * @param n the number of cells
+ * @param valid the fraction of cells holding a number
+ */
+std::vector<std::string> mostly_invalid_column(std::size_t n, double valid)
+{
+    std::mt19937_64 gen(42);
+    std::uniform_real_distribution<double> coin(0, 1);
+    std::uniform_int_distribution<std::uint64_t> position(1, 250'000'000);
+    std::vector<std::string> junk = {"", "NR", "x", "1 x 3", "NA", "-"};
+
+    std::vector<std::string> col;
+    col.reserve(n);
+    for(std::size_t i{0}; i < n; i++)
+        col.push_back(coin(gen) < valid ? std::to_string(position(gen)) : junk[i % junk.size()]);
+    return col;
+}
+
+/**
+ * @return whether both parsers accepted the same number of cells
+ */
+bool bench_parse()
+{
+    auto col = mostly_invalid_column(1'000'000, 0.2);
+
+    std::size_t old_valid{0}, new_valid{0};
+    auto old_ms = time_ms([&](){
+        for(auto& v : col)
+            if(!std::isnan(lexical_parser<double>(v)))
+                old_valid++;
+    });
+    auto new_ms = time_ms([&](){
+        for(auto& v : col)
+            if(try_parse<double>(v))
+                new_valid++;
+    });
+
+    std::cout << "parse " << col.size() << " cells, 80% invalid: lexical_cast " << old_ms << " ms (" << old_valid
+              << " valid), try_parse " << new_ms << " ms (" << new_valid << " valid)" << std::endl;
+    return old_valid == new_valid;
+}
+
+/**
+ * A catalog-like tab separated text: many columns, mostly short cells, a few long free-text ones.
+ * @param lines the number of lines
+ */
+std::string synthetic_tsv(std::size_t lines)
+{
+    std::mt19937_64 gen(7);
+    std::uniform_int_distribution<std::size_t> len(1, 12); // no empty cells, which getTokens drops at the end of a line
+    std::string text;
+    for(std::size_t l{0}; l < lines; l++) {
+        for(std::size_t c{0}; c < 38; c++) {
+            if(c > 0)
+                text += '\t';
+            text.append(c % 9 == 6 ? 60 : len(gen), static_cast<char>('a' + c % 26));
+        }
+        text += '\n';
+    }
+    return text;
+}
+
+/**
+ * @return whether both tokenizers produced the same cells
+ */
+bool bench_tokenize()
+{
+    auto text = synthetic_tsv(200'000);
+
+    std::size_t old_cells{0}, old_bytes{0};
+    auto old_ms = time_ms([&](){
+        std::istringstream in(text);
+        std::string line;
+        while(std::getline(in, line))
+            for(auto& token : getTokens(line)) {
+                old_cells++;
+                old_bytes += token.size();
+            }
+    });
+
+    std::size_t new_cells{0}, new_bytes{0};
+    auto new_ms = time_ms([&](){
+        for_each_cell(text, [&](std::size_t, std::string_view v){ new_cells++; new_bytes += v.size(); }, [](){});
+    });
+
+    std::cout << "tokenize " << text.size() / (1 << 20) << " MB: getTokens " << old_ms << " ms (" << old_cells
+              << " cells, " << old_bytes << " bytes), for_each_cell " << new_ms << " ms (" << new_cells << " cells, "
+              << new_bytes << " bytes)" << std::endl;
+    return old_cells == new_cells && old_bytes == new_bytes;
+}
+
+int main() {
+    bool agree = bench_parse();
+    agree = bench_tokenize() && agree;
+    if(!agree) {
+        std::cerr << "old and new paths disagree" << std::endl;
+        return 1;
+    }
+    return 0;
+}
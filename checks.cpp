@@ -0,0 +1,81 @@
+#include <cmath>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <unistd.h>
+
+#include "BedFile.hxx"
+#include "MultiTraitScore.hxx"
+#include "VcfReader.hxx"
+
+//
+// Regression checks of the genotype readers, run by ctest.
+//
+
+namespace {
+
+int failures{0};
+
+void expect(bool ok, const std::string& what)
+{
+    if(!ok) {
+        std::cerr << "FAILED: " << what << std::endl;
+        failures++;
+    }
+}
+
+bool near(double a, double b) { return std::abs(a - b) < 1e-5; }
+
+/**
+ * Two traits weighting the two alleles of one rsID: T1 gives rs1 A an odds ratio of 2, T2 gives rs1 G one of 3. The
+ * panel has a column for each, and both the VCF and the .bed reader must fill both from the single rs1 record.
+ */
+void both_alleles_of_one_site(const std::filesystem::path& dir)
+{
+    FlatFile catalog({"DISEASE/TRAIT", "SNPS", "STRONGEST SNP-RISK ALLELE", "CHR_ID", "CHR_POS", "OR or BETA", "P-VALUE"},
+                     {{"T1", "rs1", "rs1-A", "1", "100", "2", "1E-8"},
+                      {"T2", "rs1", "rs1-G", "1", "100", "3", "1E-9"}});
+    MultiTraitScore multi{GWAS(std::move(catalog))};
+    expect(multi.traits.size() == 2 && multi.panel.variants.size() == 2, "one panel column per risk allele of rs1");
+
+    // one heterozygous sample: one copy of A (REF) and one of G (ALT)
+    auto vcf = (dir / "site.vcf").string();
+    std::ofstream(vcf) << "##fileformat=VCFv4.2\n"
+                       << "#CHROM\tPOS\tID\tREF\tALT\tQUAL\tFILTER\tINFO\tFORMAT\tS1\n"
+                       << "1\t100\trs1\tA\tG\t.\tPASS\t.\tGT\t0/1\n";
+    VcfReader reader(vcf);
+    auto dosages = reader.read(multi.panel, 2);
+    expect(reader.matched() == std::vector<bool>{true, true}, "VCF matches both alleles of rs1");
+    auto scores = multi.score(dosages, 1);
+    for(std::size_t t{0}; t < multi.traits.size(); t++)
+        expect(near(scores.sample(0)[t], std::log(multi.traits[t] == "T1" ? 2.0 : 3.0)), "VCF scores " + multi.traits[t]);
+
+    // the same sample as a .bed fileset, A1 = A and A2 = G, genotype code 10 (one copy of each)
+    auto prefix = (dir / "site").string();
+    std::ofstream(prefix + ".bim") << "1\trs1\t0\t100\tA\tG\n";
+    std::ofstream(prefix + ".fam") << "F1 S1 0 0 0 -9\n";
+    std::ofstream(prefix + ".bed", std::ios::binary) << '\x6c' << '\x1b' << '\x01' << '\x02';
+    BedFile bed(prefix);
+    auto weighted = multi.panel;
+    for(auto& v : weighted.variants)
+        v.weight = std::log(v.allele == "A" ? 2.0 : 3.0);
+    auto total = bed.score(weighted, 1);
+    expect(bed.matched() == std::vector<bool>{true, true}, ".bed matches both alleles of rs1");
+    expect(near(total[0], std::log(2.0) + std::log(3.0)), ".bed counts one copy of each allele of rs1");
+}
+
+} // namespace
+
+int main() {
+    auto dir = std::filesystem::temp_directory_path() / ("gen_risk2_checks." + std::to_string(::getpid()));
+    std::filesystem::create_directories(dir);
+    both_alleles_of_one_site(dir);
+    std::filesystem::remove_all(dir);
+
+    if(failures)
+        std::cerr << failures << " check(s) failed" << std::endl;
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,178 @@
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "GWAS.hxx"
+#include "Parallel.hxx"
+#include "PolygenicScore.hxx"
+
+//
+// Scoring genotypes kept in the 2-bit packing of PLINK 1 .bed files.
+//
+
+#ifndef GEN_RISK2_BEDFILE_HXX
+#define GEN_RISK2_BEDFILE_HXX
+
+/**
+ * A PLINK 1 binary fileset: .bed genotypes, .bim variants and .fam samples sharing one prefix. The .bed file is memory
+ * mapped and never unpacked: each variant is a row of bytes, each byte holding the 2-bit genotypes of four samples
+ * (00 two copies of A1, 01 missing, 10 one copy, 11 no copy).
+ */
+class BedFile{
+
+    static constexpr std::uint8_t bed_magic[3]{0x6c, 0x1b, 0x01}; // PLINK 1 .bed in variant-major order
+
+    /**
+     * One line of the .bim file. The views point into the mapped .bim file.
+     */
+    struct BimVariant{
+
+        std::string_view chr;
+        std::string_view id;
+        std::string_view pos;
+        std::string_view a1;
+        std::string_view a2;
+    };
+
+    std::shared_ptr<const MappedFile> bed;
+    std::shared_ptr<const MappedFile> bim;
+    std::vector<BimVariant>           variants_;
+    std::vector<std::string>          samples_;
+    std::size_t                       row_bytes{0}; // bytes per variant, four samples to a byte
+    std::vector<bool>                 matched_;
+
+    /**
+     * Calls emit on every field of a line separated by tabs or spaces, as PLINK writes either.
+     */
+    template<typename Emit>
+    static void for_each_field(std::string_view line, Emit emit) {
+        while(true) {
+            auto start = line.find_first_not_of(" \t");
+            if(start == std::string_view::npos)
+                return;
+            line.remove_prefix(start);
+            auto end = line.find_first_of(" \t");
+            emit(line.substr(0, end));
+            if(end == std::string_view::npos)
+                return;
+            line.remove_prefix(end);
+        }
+    }
+
+public:
+
+    /**
+     * Opens prefix.bed, prefix.bim and prefix.fam.
+     * @param prefix the path of the fileset without extension
+     */
+    explicit BedFile(const std::string& prefix)
+    {
+        bim = std::make_shared<const MappedFile>(prefix + ".bim");
+        for_each_line(bim->view(), [this](std::string_view line){
+            std::string_view f[6];
+            std::size_t n{0};
+            for_each_field(line, [&](std::string_view field){ if(n < 6) f[n++] = field; });
+            if(n < 6)
+                throw std::runtime_error("bad .bim line: " + std::string(line));
+            variants_.push_back({f[0], f[1], f[3], f[4], f[5]});
+        });
+
+        auto fam = std::make_shared<const MappedFile>(prefix + ".fam");
+        for_each_line(fam->view(), [this](std::string_view line){
+            std::size_t n{0};
+            for_each_field(line, [&](std::string_view field){ if(n++ == 1) samples_.emplace_back(field); });
+        });
+
+        bed = std::make_shared<const MappedFile>(prefix + ".bed");
+        row_bytes = (samples_.size() + 3) / 4;
+        auto bytes = bed->view();
+        if(bytes.size() < 3 || std::memcmp(bytes.data(), bed_magic, 3) != 0)
+            throw std::runtime_error(prefix + ".bed is not a variant-major PLINK 1 .bed file");
+        if(bytes.size() != 3 + variants_.size() * row_bytes)
+            throw std::runtime_error(prefix + ".bed does not match the size of the .bim and .fam files");
+    }
+
+    [[nodiscard]] auto samples() const -> const std::vector<std::string>& { return samples_; }
+
+    [[nodiscard]] std::size_t num_variants() const { return variants_.size(); }
+
+    /**
+     * @return for every variant of the score last computed, whether the fileset had it
+     */
+    [[nodiscard]] auto matched() const -> const std::vector<bool>& { return matched_; }
+
+    /**
+     * Scores every sample. The score's variants are joined to the .bim file through a hash table on rsID, or chromosome
+     * and position, and a variant counts if one of its alleles is the risk allele; a site weighted for both of its
+     * alleles counts for each. Each matched variant gets a 256-entry table giving, for any byte of its row, the weighted
+     * dosages of the four samples in it, so scoring reads every byte once and adds four looked-up values without
+     * unpacking anything. Samples are split into byte ranges scored in parallel. Missing genotypes add nothing.
+     * @param score the weights
+     * @param threads the most threads to use, 0 for one per hardware thread
+     * @return the score of every sample, in .fam order
+     */
+    [[nodiscard]] std::vector<double> score(const PolygenicScore& score, unsigned threads = 0)
+    {
+        // (bed row, weight of each 2-bit code) of every matched variant
+        struct Match{ std::size_t row; std::array<float, 4> by_code; };
+        std::vector<Match> matches;
+        VariantLookup lookup(score);
+        matched_.assign(score.variants.size(), false);
+        for(std::size_t r{0}; r < variants_.size(); r++) {
+            auto& bv = variants_[r];
+            for(auto v : lookup.find(bv.chr, bv.pos, bv.id)) { // every risk allele the score weights at this site
+                if(matched_[v])
+                    continue;
+                auto& risk = score.variants[v].allele;
+                auto  w    = static_cast<float>(score.variants[v].weight);
+                if(bv.a1 == risk)
+                    matches.push_back({r, {2 * w, 0, w, 0}});
+                else if(bv.a2 == risk)
+                    matches.push_back({r, {0, 0, w, 2 * w}});
+                else
+                    continue;
+                matched_[v] = true;
+            }
+        }
+
+        // the 256-entry tables are built once per variant and shared by every sample range; they are built a block of
+        // variants at a time, 4 MB, so memory stays bounded however many variants the score has
+        constexpr std::size_t range_bytes{8192}; // samples handed to a thread at a time, four per byte
+        constexpr std::size_t lut_block  {1024}; // variants whose tables are built at a time
+        auto genotypes = reinterpret_cast<const std::uint8_t*>(bed->view().data()) + 3;
+        std::vector<double> acc(row_bytes * 4, 0.0); // per sample, padded to whole bytes
+        std::vector<std::array<std::array<float, 4>, 256>> luts(std::min(lut_block, matches.size()));
+        for(std::size_t first_match{0}; first_match < matches.size(); first_match += lut_block) {
+            auto n_matches = std::min(lut_block, matches.size() - first_match);
+            parallel_for(n_matches, [&](std::size_t i){
+                auto& by_code = matches[first_match + i].by_code;
+                for(std::size_t b{0}; b < 256; b++)
+                    for(std::size_t k{0}; k < 4; k++)
+                        luts[i][b][k] = by_code[(b >> (2 * k)) & 3];
+            }, threads);
+            parallel_for((row_bytes + range_bytes - 1) / range_bytes, [&](std::size_t t){
+                auto first = t * range_bytes;
+                auto last  = std::min(first + range_bytes, row_bytes);
+                for(std::size_t i{0}; i < n_matches; i++) {
+                    auto& lut = luts[i];
+                    auto  row = genotypes + matches[first_match + i].row * row_bytes;
+                    for(auto b = first; b < last; b++) {
+                        auto& add = lut[row[b]];
+                        auto  out = acc.data() + b * 4;
+                        for(std::size_t k{0}; k < 4; k++)
+                            out[k] += add[k];
+                    }
+                }
+            }, threads);
+        }
+        return {acc.begin(), acc.begin() + static_cast<std::ptrdiff_t>(samples_.size())};
+    }
+};
+
+#endif //GEN_RISK2_BEDFILE_HXX
@@ -0,0 +1,266 @@
+#include <algorithm>
+#include <bit>
+#include <cassert>
+#include <cstdint>
+#include <iterator>
+#include <limits>
+#include <vector>
+
+//
+// Compressed sets of row ids.
+//
+
+#ifndef GEN_RISK2_BITMAP_HXX
+#define GEN_RISK2_BITMAP_HXX
+
+/**
+ * A set of row ids stored the way roaring bitmaps do: ids are split by their high 16 bits into containers, and each
+ * container holds the low 16 bits either as a sorted array (up to 4096 values) or as a 65536 bit set. Sparse sets
+ * stay small and dense ones are combined 64 rows per machine word.
+ */
+class Bitmap{
+
+    static constexpr std::size_t   words      {1024}; // 64 bit words in a dense container
+    static constexpr std::uint32_t array_limit{4096}; // most values a container keeps as an array
+
+    struct Container{
+
+        std::uint16_t              key {0}; // high 16 bits shared by the values
+        std::uint32_t              size{0}; // number of values
+        std::vector<std::uint16_t> array;   // the low 16 bits of every value, sorted, while the container is sparse
+        std::vector<std::uint64_t> bits;    // one bit per low 16 bits, once the container is dense
+
+        [[nodiscard]] bool dense() const { return !bits.empty(); }
+
+        [[nodiscard]] bool contains(std::uint16_t low) const {
+            if(dense())
+                return (bits[low >> 6] >> (low & 63)) & 1;
+            return std::binary_search(array.begin(), array.end(), low);
+        }
+
+        void to_bits() {
+            bits.assign(words, 0);
+            for(auto low : array)
+                bits[low >> 6] |= std::uint64_t{1} << (low & 63);
+            array.clear();
+            array.shrink_to_fit();
+        }
+
+        /**
+         * Switches to the representation that suits the number of values.
+         */
+        void normalize() {
+            if(!dense() && size > array_limit)
+                to_bits();
+            else if(dense() && size <= array_limit) {
+                array.clear();
+                for_each([this](std::uint16_t low){ array.push_back(low); });
+                bits.clear();
+                bits.shrink_to_fit();
+            }
+        }
+
+        [[nodiscard]] auto dense_bits() const -> std::vector<std::uint64_t> {
+            if(dense())
+                return bits;
+            Container copy = *this;
+            copy.to_bits();
+            return std::move(copy.bits);
+        }
+
+        template<typename Fn>
+        void for_each(Fn fn) const {
+            if(!dense()) {
+                for(auto low : array)
+                    fn(low);
+                return;
+            }
+            for(std::size_t w{0}; w < words; w++)
+                for(auto word = bits[w]; word; word &= word - 1)
+                    fn(static_cast<std::uint16_t>(w * 64 + static_cast<std::size_t>(std::countr_zero(word))));
+        }
+    };
+
+    std::vector<Container> containers; // ordered by key, none of them empty
+
+    /**
+     * Combines two containers with the same key. Two sparse containers are merged as sorted arrays, anything else
+     * word by word.
+     */
+    template<typename WordOp, typename ArrayOp>
+    static Container combine(const Container& a, const Container& b, WordOp word_op, ArrayOp array_op) {
+        Container out;
+        out.key = a.key;
+        if(!a.dense() && !b.dense()) {
+            array_op(a.array.begin(), a.array.end(), b.array.begin(), b.array.end(), std::back_inserter(out.array));
+            out.size = static_cast<std::uint32_t>(out.array.size());
+        }
+        else {
+            auto x = a.dense_bits();
+            auto y = b.dense_bits();
+            out.bits.resize(words);
+            for(std::size_t w{0}; w < words; w++) {
+                out.bits[w] = word_op(x[w], y[w]);
+                out.size   += static_cast<std::uint32_t>(std::popcount(out.bits[w]));
+            }
+        }
+        out.normalize();
+        return out;
+    }
+
+    /**
+     * Walks the containers of two bitmaps in key order.
+     * @param only_a whether containers of a without a partner in b are kept
+     * @param only_b whether containers of b without a partner in a are kept
+     * @param both combines two containers with the same key
+     */
+    template<typename Both>
+    static Bitmap merge(const Bitmap& a, const Bitmap& b, bool only_a, bool only_b, Both both) {
+        Bitmap out;
+        auto i = a.containers.begin(), j = b.containers.begin();
+        while(i != a.containers.end() || j != b.containers.end()) {
+            if(j == b.containers.end() || (i != a.containers.end() && i->key < j->key)) {
+                if(only_a)
+                    out.containers.push_back(*i);
+                ++i;
+            }
+            else if(i == a.containers.end() || j->key < i->key) {
+                if(only_b)
+                    out.containers.push_back(*j);
+                ++j;
+            }
+            else {
+                auto c = both(*i++, *j++);
+                if(c.size)
+                    out.containers.push_back(std::move(c));
+            }
+        }
+        return out;
+    }
+
+public:
+
+    Bitmap() = default;
+
+    /**
+     * @param rows row ids in any order, duplicates allowed
+     */
+    explicit Bitmap(std::vector<std::size_t> rows) {
+        if(!std::is_sorted(rows.begin(), rows.end()))
+            std::sort(rows.begin(), rows.end());
+        rows.erase(std::unique(rows.begin(), rows.end()), rows.end());
+        for(auto r : rows)
+            add(r);
+    }
+
+    /**
+     * @param n a number of rows
+     * @return the rows 0 to n-1
+     */
+    static Bitmap all(std::size_t n) {
+        Bitmap out;
+        for(std::size_t r{0}; r < n; r++)
+            out.add(r);
+        return out;
+    }
+
+    /**
+     * Adds a row id larger than every id held so far, which is how a bitmap is built by a scan in row order.
+     * @param row the row id, below 2^32
+     */
+    void add(std::size_t row) {
+        assert(row <= std::numeric_limits<std::uint32_t>::max());
+        auto key = static_cast<std::uint16_t>(row >> 16);
+        auto low = static_cast<std::uint16_t>(row & 0xFFFF);
+        if(containers.empty() || containers.back().key != key) {
+            assert(containers.empty() || containers.back().key < key);
+            containers.push_back({.key = key, .size = 0, .array = {}, .bits = {}});
+        }
+        auto& c = containers.back();
+        if(c.dense())
+            c.bits[low >> 6] |= std::uint64_t{1} << (low & 63);
+        else {
+            assert(c.array.empty() || c.array.back() < low);
+            c.array.push_back(low);
+        }
+        c.size++;
+        c.normalize();
+    }
+
+    [[nodiscard]] bool contains(std::size_t row) const {
+        auto key = static_cast<std::uint16_t>(row >> 16);
+        auto it  = std::lower_bound(containers.begin(), containers.end(), key,
+                                    [](const Container& c, std::uint16_t k){ return c.key < k; });
+        return it != containers.end() && it->key == key && it->contains(static_cast<std::uint16_t>(row & 0xFFFF));
+    }
+
+    /**
+     * @return the number of rows held
+     */
+    [[nodiscard]] std::size_t size() const {
+        std::size_t n{0};
+        for(auto& c : containers)
+            n += c.size;
+        return n;
+    }
+
+    [[nodiscard]] bool empty() const { return containers.empty(); }
+
+    /**
+     * Calls fn with every row held, in increasing order.
+     */
+    template<typename Fn>
+    void for_each(Fn fn) const {
+        for(auto& c : containers) {
+            std::size_t high = std::size_t{c.key} << 16;
+            c.for_each([&](std::uint16_t low){ fn(high | low); });
+        }
+    }
+
+    /**
+     * @return the rows held, in increasing order
+     */
+    [[nodiscard]] std::vector<std::size_t> rows() const {
+        std::vector<std::size_t> out;
+        out.reserve(size());
+        for_each([&out](std::size_t r){ out.push_back(r); });
+        return out;
+    }
+
+    friend Bitmap operator&(const Bitmap& a, const Bitmap& b) {
+        return merge(a, b, false, false, [](const Container& x, const Container& y){
+            if(x.dense() != y.dense()) { // probe the bits with the array
+                auto& sparse = x.dense() ? y : x;
+                auto& dense  = x.dense() ? x : y;
+                Container out;
+                out.key = x.key;
+                for(auto low : sparse.array)
+                    if(dense.contains(low))
+                        out.array.push_back(low);
+                out.size = static_cast<std::uint32_t>(out.array.size());
+                return out;
+            }
+            return combine(x, y, [](std::uint64_t p, std::uint64_t q){ return p & q; },
+                           [](auto... args){ return std::set_intersection(args...); });
+        });
+    }
+
+    friend Bitmap operator|(const Bitmap& a, const Bitmap& b) {
+        return merge(a, b, true, true, [](const Container& x, const Container& y){
+            return combine(x, y, [](std::uint64_t p, std::uint64_t q){ return p | q; },
+                           [](auto... args){ return std::set_union(args...); });
+        });
+    }
+
+    /**
+     * @return the rows of a that are not in b
+     */
+    friend Bitmap operator-(const Bitmap& a, const Bitmap& b) {
+        return merge(a, b, true, false, [](const Container& x, const Container& y){
+            return combine(x, y, [](std::uint64_t p, std::uint64_t q){ return p & ~q; },
+                           [](auto... args){ return std::set_difference(args...); });
+        });
+    }
+};
+
+#endif //GEN_RISK2_BITMAP_HXX
@@ -0,0 +1,99 @@
+#include <algorithm>
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+#include "GWAS.hxx"
+#include "Parallel.hxx"
+
+//
+// Associations reported at the exact same position, and whether they agree with each other.
+//
+
+#ifndef GEN_RISK2_COLOCATION_HXX
+#define GEN_RISK2_COLOCATION_HXX
+
+/**
+ * One position holding several associations.
+ */
+struct Locus{
+
+    std::string_view              chr;
+    std::uint64_t                 pos         {0};
+    std::vector<std::size_t>      rows;         // table rows of the associations at this position, in table order
+    std::size_t                   with_effect {0}; // how many of them report an effect size
+    double                        min_effect  {0};
+    double                        max_effect  {0};
+    std::vector<std::string_view> risk_alleles; // distinct risk alleles in first-seen order, '?' left out
+
+    [[nodiscard]] double spread() const { return max_effect - min_effect; }
+
+    /**
+     * @return true if the associations name more than one risk allele
+     */
+    [[nodiscard]] bool allele_conflict() const { return risk_alleles.size() > 1; }
+};
+
+/**
+ * Groups associations by exact locus (CHR_ID, CHR_POS) and reports, for every locus with at least two associations,
+ * the spread of OR or BETA and the risk alleles named in STRONGEST SNP-RISK ALLELE. Each chromosome is sorted by
+ * position on its own, in parallel, so the whole catalog takes O(n log n).
+ * @param gwas the associations to look at
+ * @return the shared loci, by chromosome (in order of first appearance) then position
+ */
+inline std::vector<Locus> colocated_loci(const GWAS& gwas)
+{
+    auto& file    = gwas.file;
+    auto  alleles = file.index_of.at("STRONGEST SNP-RISK ALLELE");
+    auto  pos_col = file.index_of.at(gwas_col::Position::name);
+    auto  eff_col = file.index_of.at(gwas_col::EffectSize::name);
+
+    auto by_chr = gwas.group_by("CHR_ID");
+    std::vector<std::vector<Locus>> per_chr(by_chr.size());
+
+    parallel_for(by_chr.size(), [&](std::size_t c){
+        auto& [key, assocs] = by_chr[c];
+        auto position = assocs.file.numeric_reader<gwas_col::Position::type>(pos_col);
+        auto effect   = assocs.file.numeric_reader<gwas_col::EffectSize::type>(eff_col);
+        auto& allele  = assocs.file.column(alleles);
+
+        std::vector<std::pair<std::uint64_t, std::size_t>> located; // (position, table row)
+        located.reserve(assocs.size());
+        for(auto r : assocs.file.rows())
+            if(auto p = position(r))
+                located.emplace_back(*p, r);
+        std::sort(located.begin(), located.end());
+
+        for(std::size_t begin{0}, end; begin < located.size(); begin = end) {
+            end = begin + 1;
+            while(end < located.size() && located[end].first == located[begin].first)
+                end++;
+            if(end - begin < 2)
+                continue;
+
+            Locus locus;
+            locus.chr = key[0];
+            locus.pos = located[begin].first;
+            for(auto i = begin; i < end; i++) {
+                auto r = located[i].second;
+                locus.rows.push_back(r);
+                if(auto e = effect(r)) {
+                    locus.min_effect = locus.with_effect ? std::min(locus.min_effect, *e) : *e;
+                    locus.max_effect = locus.with_effect ? std::max(locus.max_effect, *e) : *e;
+                    locus.with_effect++;
+                }
+                auto a = risk_allele_of(allele[r]);
+                if(!a.empty() && std::find(locus.risk_alleles.begin(), locus.risk_alleles.end(), a) == locus.risk_alleles.end())
+                    locus.risk_alleles.push_back(a);
+            }
+            per_chr[c].push_back(std::move(locus));
+        }
+    });
+
+    std::vector<Locus> loci;
+    for(auto& chr_loci : per_chr)
+        loci.insert(loci.end(), std::make_move_iterator(chr_loci.begin()), std::make_move_iterator(chr_loci.end()));
+    return loci;
+}
+
+#endif //GEN_RISK2_COLOCATION_HXX
@@ -0,0 +1,135 @@
+#include <algorithm>
+#include <cstdint>
+#include <random>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "GWAS.hxx"
+#include "Parallel.hxx"
+
+//
+// Scan for genome regions holding more associations than chance allows.
+//
+
+#ifndef GEN_RISK2_DENSITYSCAN_HXX
+#define GEN_RISK2_DENSITYSCAN_HXX
+
+/**
+ * Chromosome lengths of GRCh38, the build the GWAS catalog reports positions on.
+ * @return chromosome name (as in CHR_ID) -> length in base pairs
+ */
+inline const std::unordered_map<std::string, std::uint64_t>& grch38_lengths(){
+    static const std::unordered_map<std::string, std::uint64_t> lengths = {
+        {"1", 248956422}, {"2", 242193529}, {"3", 198295559}, {"4", 190214555}, {"5", 181538259}, {"6", 170805979},
+        {"7", 159345973}, {"8", 145138636}, {"9", 138394717}, {"10", 133797422}, {"11", 135086622}, {"12", 133275309},
+        {"13", 114364328}, {"14", 107043718}, {"15", 101991189}, {"16", 90338345}, {"17", 83257441}, {"18", 80373285},
+        {"19", 58617616}, {"20", 64444167}, {"21", 46709983}, {"22", 50818468}, {"X", 156040895}, {"Y", 57227415}};
+    return lengths;
+}
+
+/**
+ * Settings of density_scan.
+ */
+struct DensityOptions{
+
+    std::uint64_t window      {1'000'000}; // width of a window in base pairs, rounded up to a multiple of step
+    std::uint64_t step        {1'000'000}; // distance between window starts; equal to window for fixed windows
+    std::size_t   permutations{1000};      // draws from the null per chromosome
+    std::uint64_t seed        {1};         // results are reproducible for a given seed
+    unsigned      threads     {0};         // 0 for one per hardware thread
+};
+
+/**
+ * The association count of one window and how surprising it is.
+ */
+struct WindowCount{
+
+    std::string   chr;
+    std::uint64_t start   {0}; // first base of the window
+    std::uint64_t end     {0}; // one past the last base of the window
+    std::size_t   count   {0}; // associations in the window
+    double        expected{0}; // mean count of a window under the null
+    double        p_value {1}; // chance that the busiest window of the chromosome holds at least count under the null
+};
+
+/**
+ * Counts associations in fixed or sliding windows along every chromosome and compares each count with a uniform
+ * background: the null spreads a chromosome's associations uniformly at random over its length. Every permutation
+ * records the largest window count of the chromosome, so the p-values are corrected for scanning all its windows
+ * (p = (1 + #permutations with max >= count) / (1 + permutations)).
+ *
+ * Associations are binned by step, so a window is a run of window/step bins summed with a prefix sum, and a
+ * permutation costs one random draw per association plus one pass over the bins. Chromosomes are scanned in parallel.
+ * @param gwas the associations to scan, e.g. a whole catalog or one disease
+ * @param options window layout, number of permutations, seed and threads
+ * @param lengths chromosome lengths; chromosomes missing from it extend to their last association
+ * @return every window of every chromosome with at least one association, by chromosome then start
+ */
+inline std::vector<WindowCount> density_scan(const GWAS& gwas, const DensityOptions& options = {},
+                                             const std::unordered_map<std::string, std::uint64_t>& lengths = grch38_lengths())
+{
+    auto step         = std::max<std::uint64_t>(options.step, 1);
+    auto bins_per_win = std::max<std::uint64_t>((options.window + step - 1) / step, 1);
+
+    auto by_chr = gwas.group_by("CHR_ID");
+    std::vector<std::vector<WindowCount>> per_chr(by_chr.size());
+
+    parallel_for(by_chr.size(), [&](std::size_t c){
+        auto& [key, assocs] = by_chr[c];
+        std::string chr(key[0]);
+        auto extracted  = assocs.extract<gwas_col::Position>();
+        auto& positions = extracted.get<gwas_col::Position>();
+        if(positions.empty())
+            return;
+
+        auto known  = lengths.find(chr);
+        auto length = std::max(known != lengths.end() ? known->second : 0, *std::max_element(positions.begin(), positions.end()) + 1);
+        auto n_bins = static_cast<std::size_t>((length + step - 1) / step);
+        auto n_wins = n_bins > bins_per_win ? n_bins - bins_per_win + 1 : 1;
+
+        // count of every window, from a prefix sum over the bins
+        std::vector<std::uint32_t> bins(n_bins, 0), prefix(n_bins + 1, 0), observed(n_wins);
+        auto window_counts = [&](std::vector<std::uint32_t>& wins){
+            for(std::size_t b{0}; b < n_bins; b++)
+                prefix[b + 1] = prefix[b] + bins[b];
+            for(std::size_t w{0}; w < n_wins; w++)
+                wins[w] = prefix[std::min<std::size_t>(w + bins_per_win, n_bins)] - prefix[w];
+        };
+        for(auto p : positions)
+            bins[p / step]++;
+        window_counts(observed);
+
+        // null distribution of the busiest window
+        std::mt19937_64 rng(options.seed + c);
+        std::vector<std::uint32_t> null_max(options.permutations), wins(n_wins);
+        for(auto& m : null_max) {
+            std::fill(bins.begin(), bins.end(), 0);
+            for(std::size_t i{0}; i < positions.size(); i++) {
+                auto pos = static_cast<std::uint64_t>((static_cast<unsigned __int128>(rng()) * length) >> 64); // uniform in [0, length)
+                bins[pos / step]++;
+            }
+            window_counts(wins);
+            m = *std::max_element(wins.begin(), wins.end());
+        }
+        std::sort(null_max.begin(), null_max.end());
+
+        auto width    = bins_per_win * step;
+        auto expected = static_cast<double>(positions.size()) * static_cast<double>(std::min(width, length)) / static_cast<double>(length);
+        for(std::size_t w{0}; w < n_wins; w++) {
+            if(observed[w] == 0)
+                continue;
+            auto at_least = static_cast<std::size_t>(null_max.end() - std::lower_bound(null_max.begin(), null_max.end(), observed[w]));
+            auto start    = static_cast<std::uint64_t>(w) * step;
+            per_chr[c].push_back({chr, start, std::min(start + width, length), observed[w], expected,
+                                  static_cast<double>(1 + at_least) / static_cast<double>(1 + options.permutations)});
+        }
+    }, options.threads);
+
+    std::vector<WindowCount> windows;
+    for(auto& chr_windows : per_chr)
+        windows.insert(windows.end(), std::make_move_iterator(chr_windows.begin()), std::make_move_iterator(chr_windows.end()));
+    return windows;
+}
+
+#endif //GEN_RISK2_DENSITYSCAN_HXX
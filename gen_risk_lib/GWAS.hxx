@@ -1,8 +1,36 @@
 #include <memory>
+#include <mutex>
+#include <numeric>
+#include <optional>
 #include <utility>
-#include <sstream>
 #include <cassert>
-#include <boost/lexical_cast.hpp>
+#include <charconv>
+#include <concepts>
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <iostream>
+#include <limits>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <tuple>
+#include <type_traits>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "Parallel.hxx"
+#include "Scanner.hxx"
+#include "Snapshot.hxx"
 
 //
 // Created by dam on 2/13/21.
@@ -11,224 +39,1418 @@
 #ifndef GEN_RISK2_GWAS_HXX
 #define GEN_RISK2_GWAS_HXX
 
+/**
+ * Parses a whole string as an integer, without exceptions or allocations.
+ * @tparam T The integer type to which the string will be converted.
+ * @param v The string that will be parsed
+ * @return The parsed value, or nothing if v is empty, is not entirely a base 10 integer, or is out of range for T.
+ */
+template<std::integral T>
+auto try_parse(std::string_view v) -> std::optional<T> {
+    if(!v.empty() && v.front() == '+') {
+        v.remove_prefix(1);
+        if(!v.empty() && v.front() == '-') // "+-5" is not a number
+            return std::nullopt;
+    }
+    T out{};
+    auto [end, ec] = std::from_chars(v.data(), v.data() + v.size(), out);
+    if(v.empty() || ec != std::errc() || end != v.data() + v.size())
+        return std::nullopt;
+    return out;
+}
+
+/**
+ * Parses a whole string as a floating point number, without exceptions or allocations. NaN is reported as missing,
+ * like an unparseable cell, so callers only ever see usable numbers.
+ * @tparam T The floating point type to which the string will be converted.
+ * @param v The string that will be parsed
+ * @return The parsed value, or nothing if v is empty, is not entirely a number, or is NaN.
+ */
+template<std::floating_point T>
+auto try_parse(std::string_view v) -> std::optional<T> {
+    if(!v.empty() && v.front() == '+') {
+        v.remove_prefix(1);
+        if(!v.empty() && v.front() == '-') // "+-5" is not a number
+            return std::nullopt;
+    }
+    T out{};
+    auto [end, ec] = std::from_chars(v.data(), v.data() + v.size(), out);
+    if(v.empty() || ec != std::errc() || end != v.data() + v.size() || std::isnan(out))
+        return std::nullopt;
+    return out;
+}
+
 /**
  * Generic parser that takes a string and converts it to some other data type.
  * @tparam T The data type to which the string will be converted.
  * @param v The string that will be parsed
- * @return A new value that was parsed from the string of type T.
+ * @return A new value that was parsed from the string of type T, or quiet_NaN if it cannot be parsed. For integer
+ * types quiet_NaN is 0, so use try_parse when failures must be told apart from values.
  */
 template<typename T>
-auto parser(const std::string& v) -> T {
-    try {
-        return boost::lexical_cast<T>(v);
+auto parser(std::string_view v) -> T {
+    return try_parse<T>(v).value_or(std::numeric_limits<T>::quiet_NaN());
+}
+
+/**
+ * Calls emit on every tab delimited token of a line. Unlike std::getline a trailing empty token is kept, so a line
+ * with n tabs always yields n+1 tokens.
+ * @param line a single line without its newline
+ * @param emit called with a view of each token, in order
+ */
+template<typename Emit>
+void for_each_token(std::string_view line, Emit emit){
+    std::size_t start{0};
+    for(std::size_t tab; (tab = line.find('\t', start)) != std::string_view::npos; start = tab + 1)
+        emit(line.substr(start, tab - start));
+    emit(line.substr(start));
+}
+
+/**
+ * Finds one token of a line without splitting the rest of it: only the tabs before the token are looked for.
+ * @param line a single line without its newline
+ * @param n the index of the token, counting from 0
+ * @return the token, empty if the line has fewer tokens
+ */
+inline std::string_view nth_token(std::string_view line, std::size_t n){
+    std::size_t start{0};
+    for(; n > 0; n--) {
+        auto tab = line.find('\t', start);
+        if(tab == std::string_view::npos)
+            return {};
+        start = tab + 1;
     }
-    catch(const boost::wrapexcept<boost::bad_lexical_cast>& bc){
-        return std::numeric_limits<T>::quiet_NaN();
+    return line.substr(start, line.find('\t', start) - start);
+}
+
+/**
+ * Calls emit on every non-empty line of a text. Lines are passed without their newline or a trailing carriage return.
+ * @param text the text to split
+ * @param emit called with a view of each line, in order
+ */
+template<typename Emit>
+void for_each_line(std::string_view text, Emit emit){
+    while(!text.empty()) {
+        auto eol  = text.find('\n');
+        auto line = text.substr(0, eol);
+        text.remove_prefix(eol == std::string_view::npos ? text.size() : eol + 1);
+        if(!line.empty() && line.back() == '\r')
+            line.remove_suffix(1);
+        if(!line.empty())
+            emit(line);
     }
 }
 
 /**
- * Used to convert a string to a set of tab delimeted tokens.
- * @param line a string reference
- * @return list of tokens
+ * Splits a text into about n pieces of similar size without splitting any line: every piece but the last ends right
+ * after a newline.
+ * @param text the text to split
+ * @param n the number of pieces wanted
+ * @return the pieces, in order, together covering the whole text
  */
-std::vector<std::string> getTokens(std::string& line){
-    std::vector<std::string> tokens;
-
-    std::istringstream iss(line);
-    std::string token;
-    while (std::getline(iss, token, '\t'))
-        tokens.push_back(token);
-    return tokens;
+inline std::vector<std::string_view> split_at_lines(std::string_view text, std::size_t n){
+    std::vector<std::string_view> chunks;
+    auto target = std::max<std::size_t>(1, text.size() / std::max<std::size_t>(n, 1));
+    while(!text.empty()) {
+        auto eol = text.find('\n', std::min(text.size(), target) - 1);
+        auto end = eol == std::string_view::npos ? text.size() : eol + 1;
+        chunks.push_back(text.substr(0, end));
+        text.remove_prefix(end);
+    }
+    return chunks;
 }
 
 /**
- * Returns the intersection of two interables.
- * @tparam scalar The data type of the iterables
- * @tparam collection1 The data type of the first set
- * @tparam collection2 The data type of the second set
- * @param a The first set
- * @param b The second set
- * @return The intersection betewen a and b
+ * @param strongest a STRONGEST SNP-RISK ALLELE cell such as "rs7903146-T"
+ * @return the allele after the last '-', empty if there is none or it is unknown ('?')
  */
-template<typename scalar, typename collection1, typename collection2>
-auto intersect(collection1 a, collection2 b) -> std::set<scalar>
+inline std::string_view risk_allele_of(std::string_view strongest)
 {
-    std::set<scalar> s(a.begin(), a.end());
-    std::set<scalar> intersect_mask;
+    auto dash = strongest.rfind('-');
+    if(dash == std::string_view::npos)
+        return {};
+    auto allele = strongest.substr(dash + 1);
+    return allele == "?" ? std::string_view{} : allele;
+}
+
+/**
+ * A read only memory mapping of a whole file. Views into the mapping are only valid while this object is alive, so
+ * it is meant to be held through a shared_ptr by everything that keeps such views.
+ */
+class MappedFile{
 
-    for(auto i : b)
-        if(s.contains(i)) // log complexity on each lookup
-            intersect_mask.insert(i);
+    const char* addr{nullptr};
+    std::size_t len{0};
 
-    return intersect_mask;
-}
+public:
+
+    explicit MappedFile(const std::string& file){
+        int fd = ::open(file.c_str(), O_RDONLY);
+        if(fd < 0)
+            throw std::runtime_error("could not open " + file);
+
+        struct stat st{};
+        if(::fstat(fd, &st) != 0) {
+            ::close(fd);
+            throw std::runtime_error("could not stat " + file);
+        }
+
+        len = static_cast<std::size_t>(st.st_size);
+        if(len > 0) {
+            void* p = ::mmap(nullptr, len, PROT_READ, MAP_PRIVATE, fd, 0);
+            if(p == MAP_FAILED) {
+                ::close(fd);
+                throw std::runtime_error("could not mmap " + file);
+            }
+            // cells, and snapshot columns, stay views into the mapping and are read at random for as long as the table
+            // lives, so no sequential hint; reading it all in ahead suits both the parse and the later lookups
+            ::madvise(p, len, MADV_WILLNEED);
+            addr = static_cast<const char*>(p);
+        }
+        ::close(fd); // the mapping stays valid after the descriptor is closed
+    }
+
+    MappedFile(const MappedFile&)            = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    ~MappedFile(){
+        if(addr)
+            ::munmap(const_cast<char*>(addr), len);
+    }
+
+    [[nodiscard]] std::string_view view() const { return {addr, len}; }
+};
 
 /**
- * Get all lines from a file
- * @param file the file to be read into memory
- * @return a vector of strings
+ * An interned string table. Every distinct value gets a dense code, in the order the values are first seen.
  */
-std::vector<std::string> get_lines(const std::string& file){
-    std::ifstream infile(file);
-    std::vector<std::string> lines;
-
-    std::string line;
-    while(getline( infile, line ))
-        lines.push_back(line);
-    assert(!lines.empty());
-    return lines;
-}
+struct Dictionary{
+
+    std::vector<std::string_view> values; // code -> value
+
+    Dictionary() = default;
+
+    /**
+     * Wraps values that are already distinct, e.g. read back from a snapshot. The value -> code lookup is only built
+     * the first time find is called.
+     * @param distinct the value of every code
+     */
+    explicit Dictionary(std::vector<std::string_view> distinct) : values(std::move(distinct)), indexed(false){}
+
+    /**
+     * @param v a value
+     * @return the code of v, adding v to the table if it is not in it yet
+     */
+    std::uint32_t intern(std::string_view v){
+        if(!indexed.load(std::memory_order_relaxed)) // interning is not thread safe anyway, so no lock is needed here
+            buildIndex();
+        auto [it, added] = code_of.try_emplace(v, static_cast<std::uint32_t>(values.size()));
+        if(added)
+            values.push_back(v);
+        return it->second;
+    }
+
+    /**
+     * @param v a value
+     * @return the code of v, or nothing if v is not in the table
+     */
+    [[nodiscard]] std::optional<std::uint32_t> find(std::string_view v) const {
+        if(!indexed.load(std::memory_order_acquire))
+            buildIndex();
+        auto it = code_of.find(v);
+        if(it == code_of.end())
+            return std::nullopt;
+        return it->second;
+    }
+
+    [[nodiscard]] auto size() const { return values.size(); }
+
+private:
+
+    mutable std::mutex                                          index_mtx;
+    mutable std::atomic<bool>                                   indexed{true};
+    mutable std::unordered_map<std::string_view, std::uint32_t> code_of; // value -> code
+
+    void buildIndex() const {
+        std::lock_guard lock(index_mtx);
+        if(indexed.load(std::memory_order_relaxed))
+            return;
+        code_of.reserve(values.size());
+        for(std::size_t code{0}; code < values.size(); code++)
+            code_of.emplace(values[code], static_cast<std::uint32_t>(code));
+        indexed.store(true, std::memory_order_release);
+    }
+};
+
+/**
+ * One text column of a FlatFile. A column is either stored plainly, as one view per row, or dictionary encoded, as one
+ * code per row plus a Dictionary shared with every subset taken from it. Dictionary encoding suits columns that repeat
+ * a small set of values across many rows.
+ */
+class StringColumn{
+
+    std::vector<std::string_view>  cells;        // plain storage
+    std::vector<std::uint32_t>     codes;        // encoded storage
+    std::span<const std::uint32_t> mapped_codes; // encoded storage that lives in a snapshot mapping, used instead of codes
+    std::shared_ptr<Dictionary>    dictionary;   // set when the column is encoded
+
+public:
+
+    StringColumn() = default;
+
+    /**
+     * Wraps an encoded column whose codes live in memory owned elsewhere (a snapshot mapping). The column cannot grow.
+     * @param a_dictionary the string table
+     * @param a_codes the code of every row
+     */
+    StringColumn(std::shared_ptr<Dictionary> a_dictionary, std::span<const std::uint32_t> a_codes)
+        : mapped_codes(a_codes), dictionary(std::move(a_dictionary)){}
+
+    /**
+     * @param a_cells the value of every row
+     * @param encode true to store the column dictionary encoded
+     */
+    StringColumn(std::vector<std::string_view> a_cells, bool encode) : cells(std::move(a_cells)){
+        if(encode)
+            this->encode();
+    }
+
+    [[nodiscard]] bool encoded() const { return dictionary != nullptr; }
+
+    [[nodiscard]] std::size_t size() const { return encoded() ? code_values().size() : cells.size(); }
+
+    std::string_view operator[](std::size_t row) const {
+        return encoded() ? dictionary->values[code_values()[row]] : cells[row];
+    }
+
+    /**
+     * @return the code of every row. Only meaningful for an encoded column.
+     */
+    [[nodiscard]] auto code_values() const -> std::span<const std::uint32_t> {
+        return mapped_codes.data() ? mapped_codes : std::span<const std::uint32_t>(codes);
+    }
+
+    /**
+     * @return the string table of an encoded column
+     */
+    [[nodiscard]] auto dict() const -> const Dictionary& { return *dictionary; }
+
+    void reserve(std::size_t n){
+        if(encoded())
+            codes.reserve(n);
+        else
+            cells.reserve(n);
+    }
+
+    void push_back(std::string_view v){
+        assert(!mapped_codes.data());
+        if(encoded())
+            codes.push_back(dictionary->intern(v));
+        else
+            cells.push_back(v);
+    }
+
+    /**
+     * Converts a plainly stored column to dictionary encoding. Does nothing if the column is already encoded.
+     */
+    void encode(){
+        if(encoded())
+            return;
+        dictionary = std::make_shared<Dictionary>();
+        codes.reserve(cells.size());
+        for(auto v : cells)
+            codes.push_back(dictionary->intern(v));
+        std::vector<std::string_view>().swap(cells);
+    }
+};
+
+/**
+ * A column of parsed numbers, kept next to the text column it was parsed from.
+ * @tparam T The type of the values
+ */
+template<typename T>
+struct NumericColumn{
+
+    std::vector<T>            values; // parsed value of every row, 0 where the cell is not a valid T
+    std::vector<std::uint8_t> valid ; // 1 where the cell parsed as a T
+
+private:
+
+    static bool parse_one(std::string_view v, T& out){
+        auto parsed = try_parse<T>(v);
+        out = parsed.value_or(T{});
+        return parsed.has_value();
+    }
+
+public:
+
+    /**
+     * Parses a whole text column once. An encoded column is parsed once per distinct value.
+     * @param cells the text of the column
+     */
+    explicit NumericColumn(const StringColumn& cells){
+        values.resize(cells.size());
+        valid .resize(cells.size());
+        if(cells.encoded()) {
+            NumericColumn per_code(cells.dict().values);
+            auto codes = cells.code_values();
+            for(std::size_t i{0}; i < codes.size(); i++) {
+                values[i] = per_code.values[codes[i]];
+                valid [i] = per_code.valid [codes[i]];
+            }
+        }
+        else
+            for(std::size_t i{0}; i < cells.size(); i++)
+                valid[i] = parse_one(cells[i], values[i]);
+    }
+
+    NumericColumn(std::vector<T> a_values, std::vector<std::uint8_t> a_valid)
+        : values(std::move(a_values)), valid(std::move(a_valid)){}
+
+    /**
+     * Parses a list of values.
+     * @param cells the text of every value
+     */
+    explicit NumericColumn(const std::vector<std::string_view>& cells){
+        values.resize(cells.size());
+        valid .resize(cells.size());
+        for(std::size_t i{0}; i < cells.size(); i++)
+            valid[i] = parse_one(cells[i], values[i]);
+    }
+};
+
+/**
+ * Reads the numeric value of table rows of one column. It uses the parsed column when one is cached and otherwise
+ * parses the text of just the rows it is asked about, so a scan over a small view never parses the whole column.
+ * @tparam T The type of the values
+ */
+template<typename T>
+struct NumericReader{
+
+    const NumericColumn<T>* parsed{nullptr};
+    const StringColumn*     text  {nullptr};
+
+    /**
+     * @param row a table row
+     * @return the value of the row, or nothing if it is missing or not a valid T
+     */
+    std::optional<T> operator()(std::size_t row) const {
+        if(parsed)
+            return parsed->valid[row] ? std::optional<T>(parsed->values[row]) : std::nullopt;
+        return try_parse<T>((*text)[row]);
+    }
+};
+
+/**
+ * A secondary index over one column: the table rows holding each value, in increasing order.
+ */
+struct EqualityIndex{
+
+    std::unordered_map<std::string_view, std::vector<std::size_t>> rows_of; // value -> table rows
+
+    /**
+     * @param v a value
+     * @return the table rows holding v, or nullptr if no row does
+     */
+    [[nodiscard]] const std::vector<std::size_t>* find(std::string_view v) const {
+        auto it = rows_of.find(v);
+        return it == rows_of.end() ? nullptr : &it->second;
+    }
+};
+
+/**
+ * Options controlling how FlatFile stores a file it loads.
+ */
+struct LoadOptions{
+
+    std::vector<std::string> dictionary_columns; // names of the columns to store dictionary encoded
+    std::vector<std::string> integer_columns;    // names of the columns to parse as std::uint64_t at load
+    std::vector<std::string> real_columns;       // names of the columns to parse as double at load
+    unsigned                 threads{0};         // threads used to parse the file, 0 for one per hardware thread
+    std::string              snapshot;           // binary snapshot to open instead of parsing, (re)written when stale; empty for none
+    std::vector<std::string> columns;            // names of the columns to load, empty for all; the rest are never stored
+    std::vector<std::pair<std::string, std::string>> filters; // (column, value): only lines matching all of them are loaded
+};
+
+/**
+ * Maps a column name to its index position. Copies share one map, so handing it to every view of a file is cheap.
+ */
+class ColumnIndex{
+
+    std::shared_ptr<const std::unordered_map<std::string, std::size_t>> map;
+
+public:
+
+    ColumnIndex() = default;
+
+    explicit ColumnIndex(const std::vector<std::string>& header){
+        auto m = std::make_shared<std::unordered_map<std::string, std::size_t>>();
+        for(std::size_t i = 0; i < header.size(); i++)
+            (*m)[header[i]] = i;
+        map = std::move(m);
+    }
+
+    [[nodiscard]] std::size_t at(const std::string& col_nm) const { return map->at(col_nm); }
+
+    [[nodiscard]] bool contains(const std::string& col_nm) const { return map && map->contains(col_nm); }
+};
 
 /**
  * This class represents a flat file that can be read in. The file should have the same number of columns in each line
  * and should have a header.
+ *
+ * Cells are stored as views into a single backing buffer (normally a memory mapping of the file) instead of as owned
+ * strings, so loading a file costs one page-in of the file plus one view per cell. Storage is column-major: every
+ * column is one contiguous vector, so a scan over one column reads memory sequentially. Columns can additionally be
+ * parsed once into a NumericColumn, which is cached next to the text.
+ *
+ * A FlatFile is a view: it shares the loaded table with every object subset from it and only owns the list of table
+ * rows it selects. Subsetting a view narrows that list and never touches the cells of the other columns.
  */
 class FlatFile{
 
     using col_nm  = std::string             ;
     using strings = std::vector<std::string>;
-    using a_row   = std::vector<std::string>;
+    using a_row   = std::vector<std::string_view>;
+    using a_col   = StringColumn;
+    using rows_t  = std::vector<std::size_t>;
+
+    template<typename T>
+    using typed_cols = std::unordered_map<std::size_t, NumericColumn<T>>; // column index -> parsed column
+
+    /**
+     * The loaded data, shared by a FlatFile and every view taken from it.
+     */
+    struct Table{
+
+        std::shared_ptr<const void>   backing; // keeps the memory behind the cell views alive (a MappedFile or a std::string)
+        strings                       header;
+        std::vector<a_col>            columns;
+        std::size_t                   n_rows{0};
+        std::shared_ptr<const rows_t> all_rows; // the selection of a view over the whole table
+
+        std::mutex                                                typed_mtx; // guards typed, which views fill lazily
+        std::tuple<typed_cols<std::uint64_t>, typed_cols<double>> typed;
+
+        std::mutex                                                               index_mtx; // guards indexes
+        std::unordered_map<std::size_t, std::shared_ptr<const EqualityIndex>>    indexes;   // column index -> index
+    };
 
 private:
 
-    strings          header;
-    std::vector<a_row> data;
+    std::shared_ptr<Table>        table;
+    std::shared_ptr<const rows_t> selection; // the table rows in this view, in order
+    bool                          ascending{true}; // true if selection is in increasing order
+
+    FlatFile(std::shared_ptr<Table> a_table, std::shared_ptr<const rows_t> a_selection, ColumnIndex an_index){ // NOLINT(cppcoreguidelines-pro-type-member-init)
+        table     = std::move(a_table);
+        selection = std::move(a_selection);
+        ascending = std::is_sorted(selection->begin(), selection->end());
+        index_of  = std::move(an_index);
+    }
+
+    static constexpr char          snapshot_magic[8]  {'G','R','S','N','A','P','\0','\0'};
+    static constexpr std::uint32_t snapshot_version   {1};
+    static constexpr std::uint32_t snapshot_byte_order{0x01020304}; // read back differently on a machine of the other endianness
+
+    FlatFile() = default;
+
+    /**
+     * Writes the snapshot format read by open_snapshot:
+     * magic, version, byte order, source stamp, rows, columns; per column its name, dictionary offsets, dictionary
+     * bytes and one code per row; then the number of parsed columns and per parsed column its index, kind (0 for
+     * std::uint64_t, 1 for double), values and validity.
+     */
+    void save_snapshot(const std::string& path, const SourceStamp& stamp) const {
+        auto tmp = path + ".tmp." + std::to_string(::getpid());
+        try {
+            SnapshotWriter out(tmp);
+            out.bytes(snapshot_magic, sizeof(snapshot_magic));
+            out.value(snapshot_version);
+            out.value(snapshot_byte_order);
+            out.value(stamp.size);
+            out.value(stamp.mtime_ns);
+            out.value(stamp.hash);
+            out.value<std::uint64_t>(num_rows());
+            out.value<std::uint64_t>(table->columns.size());
+
+            for(std::size_t c{0}; c < table->columns.size(); c++) {
+                auto& col = column(c);
+                Dictionary local;
+                auto& dict = col.encoded() ? col.dict() : local;
+                std::vector<std::uint32_t> codes;
+                codes.reserve(num_rows());
+                if(col.encoded())
+                    for(auto r : rows())
+                        codes.push_back(col.code_values()[r]);
+                else
+                    for(auto r : rows())
+                        codes.push_back(local.intern(col[r]));
+
+                std::vector<std::uint64_t> offsets{0};
+                std::string blob;
+                for(auto v : dict.values) {
+                    blob.append(v);
+                    offsets.push_back(blob.size());
+                }
+
+                out.string(table->header[c]);
+                out.array<std::uint64_t>(offsets);
+                out.array<char>(blob);
+                out.array<std::uint32_t>(codes);
+            }
+
+            std::lock_guard lock(table->typed_mtx);
+            auto& ints  = std::get<typed_cols<std::uint64_t>>(table->typed);
+            auto& reals = std::get<typed_cols<double       >>(table->typed);
+            out.value<std::uint64_t>(ints.size() + reals.size());
+            auto write_typed = [&](std::uint64_t col, std::uint8_t kind, const auto& parsed){
+                using T = typename std::remove_cvref_t<decltype(parsed.values)>::value_type;
+                std::vector<T>            values;
+                std::vector<std::uint8_t> valid;
+                for(auto r : rows()) {
+                    values.push_back(parsed.values[r]);
+                    valid .push_back(parsed.valid [r]);
+                }
+                out.value(col);
+                out.value(kind);
+                out.array<T>(values);
+                out.array<std::uint8_t>(valid);
+            };
+            for(auto& [col, parsed] : ints)
+                write_typed(col, 0, parsed);
+            for(auto& [col, parsed] : reals)
+                write_typed(col, 1, parsed);
+
+            out.finish();
+        }
+        catch(...) { // e.g. a full disk: leave no partial file behind
+            std::remove(tmp.c_str());
+            throw;
+        }
+        if(std::rename(tmp.c_str(), path.c_str()) != 0) {
+            std::remove(tmp.c_str());
+            throw std::runtime_error("could not move snapshot into place at " + path);
+        }
+    }
+
+    /**
+     * Makes this object a view over every row of its freshly loaded table.
+     */
+    void selectAllRows()
+    {
+        auto all = std::make_shared<rows_t>(table->n_rows);
+        std::iota(all->begin(), all->end(), std::size_t{0});
+        table->all_rows = all;
+        selection       = std::move(all);
+    }
 
 public:
 
-    std::unordered_map<col_nm, std::size_t> index_of; // maps the column name to its index position
+    ColumnIndex index_of; // maps the column name to its index position
 
 
-    a_row & ith_row(std::size_t i) { return this->data[i]; }
+    a_row ith_row(std::size_t i) const {
+        a_row row;
+        row.reserve(table->columns.size());
+        for(auto& col : table->columns)
+            row.push_back(col[row_id(i)]);
+        return row;
+    }
 
     void print_header(){
-        for(std::string& s : header)
+        for(std::string& s : table->header)
             std::cout << s << std::endl;
     }
 
-    auto num_rows() const{ return data.size(); }
+    auto num_rows() const -> std::size_t { return selection->size(); }
 
-    auto cell(std::size_t row, std::size_t col) -> std::string&
+    /**
+     * @return the table row behind every row of this view, in order. These are the indexes to use with column() and
+     * numeric_col().
+     */
+    auto rows() const -> const rows_t& { return *selection; }
+
+    /**
+     * @param i a row of this view
+     * @return the table row behind it
+     */
+    auto row_id(std::size_t i) const -> std::size_t { return (*selection)[i]; }
+
+    /**
+     * @return true if this view selects every row of the table in file order
+     */
+    [[nodiscard]] bool is_whole_table() const { return selection == table->all_rows; }
+
+    auto cell(std::size_t row, std::size_t col) const -> std::string_view
     {
-        return data[row][col];
+        return table->columns[col][row_id(row)];
+    }
+
+    /**
+     * @param col the index of a column
+     * @return every cell of the column in the table, indexed by table row (see rows())
+     */
+    auto column(std::size_t col) const -> const a_col& { return table->columns[col]; }
+
+    /**
+     * Returns a column parsed as numbers, indexed by table row (see rows()). The column is parsed for the whole table
+     * the first time any view asks for it and is cached afterwards.
+     * @tparam T std::uint64_t or double
+     * @param col the index of a column
+     * @return the parsed column
+     */
+    template<typename T>
+    auto numeric_col(std::size_t col) const -> const NumericColumn<T>&
+    {
+        std::lock_guard lock(table->typed_mtx);
+        auto& cache = std::get<typed_cols<T>>(table->typed);
+        auto it = cache.find(col);
+        if(it == cache.end())
+            it = cache.emplace(col, NumericColumn<T>(table->columns[col])).first;
+        return it->second; // references into an unordered_map stay valid as it grows
+    }
+
+    /**
+     * @tparam T std::uint64_t or double for a cached parsed column, any arithmetic type otherwise
+     * @param col the index of a column
+     * @return a reader of the column's values that never parses the whole column on its own
+     */
+    template<typename T>
+    auto numeric_reader(std::size_t col) const -> NumericReader<T>
+    {
+        NumericReader<T> reader{.text = &table->columns[col]};
+        if constexpr (std::is_same_v<T, std::uint64_t> || std::is_same_v<T, double>) {
+            std::lock_guard lock(table->typed_mtx);
+            auto& cache = std::get<typed_cols<T>>(table->typed);
+            if(auto it = cache.find(col); it != cache.end())
+                reader.parsed = &it->second;
+        }
+        return reader;
     }
 
     inline void initHeaderIndexMap()
     {
-        for(std::size_t i = 0; i < header.size(); i++)
-            index_of[header[i]] = i;
+        index_of = ColumnIndex(table->header);
     }
 
     FlatFile(const FlatFile & f)
     {
-        this->header   = f.header;
-        this->data     = f.data  ;
-        this->index_of = f.index_of;
+        this->table     = f.table    ;
+        this->selection = f.selection;
+        this->ascending = f.ascending;
+        this->index_of  = f.index_of ;
     }
 
     FlatFile(FlatFile &&f)  noexcept {
-        this->header   = std::move(f.header);
-        this->data     = std::move(f.data  );
-        this->index_of = std::move(f.index_of);
+        this->table     = std::move(f.table    );
+        this->selection = std::move(f.selection);
+        this->ascending = f.ascending;
+        this->index_of  = std::move(f.index_of );
     }
 
     FlatFile& operator=(FlatFile&& other) noexcept {
-        this->header   = std::move(other.header);
-        this->data     = std::move(other.data);
-        this->index_of = std::move(other.index_of);
+        this->table     = std::move(other.table    );
+        this->selection = std::move(other.selection);
+        this->ascending = other.ascending;
+        this->index_of  = std::move(other.index_of );
         return *this;
     }
 
-    FlatFile(strings a_header, std::vector<a_row> a_data){ // NOLINT(cppcoreguidelines-pro-type-member-init)
-        header = std::move(a_header);
-        data   = std::move(a_data  );
+    /**
+     * Builds a flat file from rows that are already in memory. The cells are copied into one buffer owned by this
+     * object.
+     * @param a_header the column names
+     * @param a_data the rows, each with one value per column
+     */
+    FlatFile(strings a_header, const std::vector<strings>& a_data){ // NOLINT(cppcoreguidelines-pro-type-member-init)
+        table = std::make_shared<Table>();
+        table->header = std::move(a_header);
         initHeaderIndexMap();
+
+        std::size_t bytes{0};
+        for(auto& row : a_data)
+            for(auto& v : row)
+                bytes += v.size();
+
+        auto buffer = std::make_shared<std::string>();
+        buffer->reserve(bytes); // no reallocation below, so the views taken into the buffer stay valid
+        auto& columns = table->columns;
+        columns.resize(table->header.size());
+        for(auto& col : columns)
+            col.reserve(a_data.size());
+        for(auto& row : a_data) {
+            for(std::size_t c{0}; c < columns.size(); c++) {
+                auto v = c < row.size() ? std::string_view(row[c]) : std::string_view();
+                columns[c].push_back({buffer->data() + buffer->size(), v.size()});
+                buffer->append(v);
+            }
+            table->n_rows++;
+        }
+        table->backing = std::move(buffer);
+        selectAllRows();
     }
 
-    explicit FlatFile(const std::string& file){ // NOLINT(cppcoreguidelines-pro-type-member-init)
+    /**
+     * Loads a tab delimited file by memory mapping it. No line or cell is copied; every cell is a view into the
+     * mapping, which is released once this object and all subsets taken from it are gone.
+     *
+     * The data lines are split into newline aligned chunks that are tokenized in parallel. A first parallel pass
+     * counts the rows of every chunk, so the second pass can write each chunk's cells straight to their final rows and
+     * the table comes out in file order without any stitching copies. Cells are cut with the vectorized delimiter
+     * scanner of Scanner.hxx. Cells missing from a short line stay empty and surplus cells are dropped, so that every
+     * row has exactly one cell per header column.
+     *
+     * With options.columns set only those columns are kept: the header and index_of hold just them, in file order, and
+     * the cells of the other columns are skipped by the tokenizer without being stored. A snapshot is only used if it
+     * holds exactly the columns being loaded, and is rewritten otherwise.
+     *
+     * With options.filters set only the lines holding every filter value are loaded. The filter cells are found with
+     * nth_token while the rows are counted, so a rejected line is never tokenized or stored and a load of one disease
+     * costs little more than one pass over the bytes. Filtered loads neither use nor write a snapshot.
+     * @param file the path to the file
+     * @param options which columns are loaded, how they are stored and how many threads parse them
+     */
+    explicit FlatFile(const std::string& file, const LoadOptions& options = {}){ // NOLINT(cppcoreguidelines-pro-type-member-init)
+
+        auto mapped = std::make_shared<const MappedFile>(file);
+        std::string_view text = mapped->view();
 
         // Read in header
-        auto lines = get_lines(file);
-        header = getTokens(lines[0]);
+        assert(!text.empty());
+        auto eol = text.find('\n');
+        strings file_header;
+        for_each_line(text.substr(0, eol), [&file_header](std::string_view line){
+            for_each_token(line, [&file_header](std::string_view token){ file_header.emplace_back(token); });
+        });
+        text.remove_prefix(eol == std::string_view::npos ? text.size() : eol + 1);
+
+        // the table column of every file column, npos for the columns left out
+        constexpr auto skip = std::numeric_limits<std::size_t>::max();
+        std::vector<std::size_t> table_col(file_header.size(), skip);
+        strings projected;
+        for(auto& nm : options.columns)
+            if(std::find(file_header.begin(), file_header.end(), nm) == file_header.end())
+                throw std::runtime_error("no column " + nm + " in " + file);
+        for(std::size_t c{0}; c < file_header.size(); c++)
+            if(options.columns.empty() || std::find(options.columns.begin(), options.columns.end(), file_header[c]) != options.columns.end()) {
+                table_col[c] = projected.size();
+                projected.push_back(file_header[c]);
+            }
+
+        // (file column, value) of every filter
+        std::vector<std::pair<std::size_t, std::string_view>> filters;
+        for(auto& [nm, value] : options.filters) {
+            auto it = std::find(file_header.begin(), file_header.end(), nm);
+            if(it == file_header.end())
+                throw std::runtime_error("no column " + nm + " in " + file);
+            filters.emplace_back(it - file_header.begin(), value);
+        }
+        auto keep = [&filters](std::string_view line){
+            for(auto& [col, value] : filters)
+                if(nth_token(line, col) != value)
+                    return false;
+            return true;
+        };
+
+        SourceStamp stamp;
+        bool use_snapshot = !options.snapshot.empty() && filters.empty();
+        if(use_snapshot) {
+            stamp = SourceStamp::of(file);
+            if(auto snap = open_snapshot(options.snapshot, stamp); snap && snap->table->header == projected) {
+                *this = std::move(*snap);
+                return;
+            }
+        }
+
+        table = std::make_shared<Table>();
+        table->backing = std::move(mapped);
+        table->header  = std::move(projected);
         initHeaderIndexMap();
 
         // read in the rest of the data
-        lines.erase(lines.begin());              // delete header
-        for(auto& line : lines)                  // read in every line in flat file
-            data.push_back(getTokens(line));
+        auto threads = options.threads ? options.threads : default_threads();
+        auto chunks  = split_at_lines(text, std::size_t{threads} * 4);
+
+        std::vector<std::size_t> first_row(chunks.size() + 1, 0); // first row of every chunk
+        std::vector<std::vector<std::string_view>> kept(filters.empty() ? 0 : chunks.size()); // matching lines of every chunk
+        parallel_for(chunks.size(), [&](std::size_t i){
+            std::size_t n{0};
+            if(filters.empty())
+                for_each_line(chunks[i], [&n](std::string_view){ n++; });
+            else {
+                for_each_line(chunks[i], [&](std::string_view line){ if(keep(line)) kept[i].push_back(line); });
+                n = kept[i].size();
+            }
+            first_row[i + 1] = n;
+        }, threads);
+        std::partial_sum(first_row.begin(), first_row.end(), first_row.begin());
+        table->n_rows = first_row.back();
+
+        std::vector<std::vector<std::string_view>> cells(table->header.size());
+        parallel_for(cells.size(), [&](std::size_t c){ cells[c].resize(table->n_rows); }, threads);
+        parallel_for(chunks.size(), [&](std::size_t i){
+            auto row = first_row[i];
+            auto on_cell = [&](std::size_t col, std::string_view v){
+                if(col < table_col.size() && table_col[col] != skip)
+                    cells[table_col[col]][row] = v;
+            };
+            auto on_row_end = [&row](){ row++; };
+            if(filters.empty())
+                for_each_cell(chunks[i], on_cell, on_row_end);
+            else
+                for(auto line : kept[i])
+                    for_each_cell(line, on_cell, on_row_end);
+        }, threads);
+
+        auto& header  = table->header;
+        auto& columns = table->columns;
+        columns.resize(header.size());
+        parallel_for(columns.size(), [&](std::size_t c){
+            bool encode = std::find(options.dictionary_columns.begin(), options.dictionary_columns.end(), header[c]) != options.dictionary_columns.end();
+            columns[c] = StringColumn(std::move(cells[c]), encode);
+        }, threads);
+        selectAllRows();
+
+        for(auto& nm : options.integer_columns)
+            if(index_of.contains(nm))
+                numeric_col<std::uint64_t>(index_of.at(nm));
+        for(auto& nm : options.real_columns)
+            if(index_of.contains(nm))
+                numeric_col<double>(index_of.at(nm));
+
+        if(use_snapshot) {
+            try {
+                save_snapshot(options.snapshot, stamp);
+            }
+            catch(const std::exception& e) { // the file itself loaded fine, so a snapshot that cannot be written is not fatal
+                std::cerr << "not writing snapshot " << options.snapshot << ": " << e.what() << std::endl;
+            }
+        }
+    }
+
+    /**
+     * Writes the whole table to a binary snapshot, see open_snapshot. Every column is stored dictionary encoded,
+     * together with every parsed numeric column cached so far. The file is written under a temporary name and renamed
+     * into place, so concurrent readers never see a partial snapshot.
+     * @param path where to write the snapshot
+     * @param source the text file the data was loaded from; its stamp is recorded to detect when it changes
+     * @throws std::logic_error if this is a subset view, whose rows a snapshot stamped with the whole file would pass
+     * off as all of it
+     */
+    void save_snapshot(const std::string& path, const std::string& source) const {
+        if(!is_whole_table())
+            throw std::logic_error("only a whole table can be saved as a snapshot of " + source);
+        save_snapshot(path, SourceStamp::of(source));
+    }
+
+    /**
+     * Opens a snapshot written by save_snapshot, if it is still up to date. The snapshot is memory mapped and used in
+     * place: the cells are views into its string tables and the dictionary codes are read straight from the mapping,
+     * so opening costs a small fraction of parsing the text file.
+     * @param path the snapshot
+     * @param stamp the current stamp of the text file the snapshot should have been built from
+     * @return the data, or nothing if the snapshot is missing, was built from a different version of the text file, or
+     * is not a readable snapshot of this version
+     */
+    static std::optional<FlatFile> open_snapshot(const std::string& path, const SourceStamp& stamp) {
+        if(::access(path.c_str(), R_OK) != 0)
+            return std::nullopt;
+
+        try {
+            auto mapped = std::make_shared<const MappedFile>(path);
+            SnapshotReader in(mapped->view());
+
+            if(in.bytes(sizeof(snapshot_magic)) != std::string_view(snapshot_magic, sizeof(snapshot_magic))
+               || in.value<std::uint32_t>() != snapshot_version
+               || in.value<std::uint32_t>() != snapshot_byte_order)
+                return std::nullopt;
+
+            SourceStamp built_from;
+            built_from.size     = in.value<std::uint64_t>();
+            built_from.mtime_ns = in.value<std::int64_t >();
+            built_from.hash     = in.value<std::uint64_t>();
+            if(!(built_from == stamp))
+                return std::nullopt;
+
+            auto t = std::make_shared<Table>();
+            t->n_rows   = in.value<std::uint64_t>();
+            auto n_cols = in.value<std::uint64_t>();
+            for(std::uint64_t c{0}; c < n_cols; c++) {
+                t->header.emplace_back(in.string());
+                auto offsets = in.array<std::uint64_t>();
+                auto blob    = in.array<char>();
+                auto codes   = in.array<std::uint32_t>();
+                if(offsets.empty() || offsets.back() > blob.size() || codes.size() != t->n_rows)
+                    return std::nullopt;
+
+                std::vector<std::string_view> values;
+                values.reserve(offsets.size() - 1);
+                for(std::size_t v{0}; v + 1 < offsets.size(); v++) {
+                    if(offsets[v] > offsets[v + 1])
+                        return std::nullopt;
+                    values.emplace_back(blob.data() + offsets[v], offsets[v + 1] - offsets[v]);
+                }
+                for(auto code : codes)
+                    if(code >= values.size())
+                        return std::nullopt;
+                t->columns.emplace_back(std::make_shared<Dictionary>(std::move(values)), codes);
+            }
+
+            auto n_typed = in.value<std::uint64_t>();
+            for(std::uint64_t k{0}; k < n_typed; k++) {
+                auto col  = in.value<std::uint64_t>();
+                auto kind = in.value<std::uint8_t >();
+                auto read_typed = [&]<typename T>(typed_cols<T>& cache){
+                    auto values = in.array<T>();
+                    auto valid  = in.array<std::uint8_t>();
+                    if(values.size() != t->n_rows || valid.size() != t->n_rows)
+                        throw std::runtime_error("bad typed column");
+                    cache.emplace(col, NumericColumn<T>({values.begin(), values.end()}, {valid.begin(), valid.end()}));
+                };
+                if(kind == 0)
+                    read_typed(std::get<typed_cols<std::uint64_t>>(t->typed));
+                else
+                    read_typed(std::get<typed_cols<double>>(t->typed));
+            }
+
+            t->backing = std::move(mapped);
+            FlatFile f;
+            f.table = std::move(t);
+            f.initHeaderIndexMap();
+            f.selectAllRows();
+            return f;
+        }
+        catch(const std::exception&) {
+            return std::nullopt;
+        }
     }
 
     /**
-     * Get all unique values in a column
+     * Get all unique values in a column. Encoded columns are deduplicated by dictionary code and plain columns with a
+     * hash set of views, so no string is copied. The views stay valid as long as any view of this table is alive.
      * @param col_i the index from which to get all unique values
-     * @return a set of all unique calues in the specified column
+     * @param sorted true to sort the values, false to keep them in the order they first occur
+     * @return every distinct value of the column in this view
      */
-    auto unique_col(const std::size_t col_i) -> std::set<std::string> {
-        std::set<std::string> col_v; // unique col values
-        for(auto& gwas_entry : data)
-            col_v.insert(gwas_entry[col_i]);
+    auto unique_col(const std::size_t col_i, bool sorted = false) const -> std::vector<std::string_view> {
+        std::vector<std::string_view> col_v; // unique col values
+        auto& col = column(col_i);
+        if(col.encoded()) {
+            std::vector<bool> seen(col.dict().size());
+            auto codes = col.code_values();
+            for(auto r : rows())
+                if(!seen[codes[r]]) {
+                    seen[codes[r]] = true;
+                    col_v.push_back(col.dict().values[codes[r]]);
+                }
+        }
+        else {
+            std::unordered_set<std::string_view> seen;
+            for(auto r : rows())
+                if(seen.insert(col[r]).second)
+                    col_v.push_back(col[r]);
+        }
 
+        if(sorted)
+            std::sort(col_v.begin(), col_v.end());
         return col_v;
     }
 
+    /**
+     * Counts the distinct values of a column without collecting them.
+     * @param col_i the index of the column
+     * @return the number of distinct values of the column in this view
+     */
+    auto count_distinct(const std::size_t col_i) const -> std::size_t {
+        auto& col = column(col_i);
+        if(col.encoded()) {
+            std::vector<bool> seen(col.dict().size());
+            std::size_t n{0};
+            auto codes = col.code_values();
+            for(auto r : rows())
+                if(!seen[codes[r]]) {
+                    seen[codes[r]] = true;
+                    n++;
+                }
+            return n;
+        }
+
+        std::unordered_set<std::string_view> seen;
+        for(auto r : rows())
+            seen.insert(col[r]);
+        return seen.size();
+    }
+
+    /**
+     * Counts how often every value of a column occurs, in one hash-aggregate pass (a plain array indexed by code for
+     * encoded columns).
+     * @param col_i the index of the column
+     * @param top_k keep only the k most frequent values, 0 to keep all
+     * @param min_count drop values occurring fewer times than this
+     * @return (value, count) pairs, most frequent first; equal counts keep the order the values first occur
+     */
+    auto value_counts(const std::size_t col_i, std::size_t top_k = 0, std::size_t min_count = 1) const
+        -> std::vector<std::pair<std::string_view, std::size_t>> {
+
+        std::vector<std::pair<std::string_view, std::size_t>> counts; // in first-seen order
+        auto& col = column(col_i);
+        if(col.encoded()) {
+            constexpr auto unseen = std::numeric_limits<std::size_t>::max();
+            std::vector<std::size_t> slot_of(col.dict().size(), unseen);
+            auto codes = col.code_values();
+            for(auto r : rows()) {
+                auto& slot = slot_of[codes[r]];
+                if(slot == unseen) {
+                    slot = counts.size();
+                    counts.emplace_back(col.dict().values[codes[r]], 0);
+                }
+                counts[slot].second++;
+            }
+        }
+        else {
+            std::unordered_map<std::string_view, std::size_t> slot_of;
+            for(auto r : rows()) {
+                auto [it, added] = slot_of.try_emplace(col[r], counts.size());
+                if(added)
+                    counts.emplace_back(col[r], 0);
+                counts[it->second].second++;
+            }
+        }
+
+        std::erase_if(counts, [min_count](auto& vc){ return vc.second < min_count; });
+        auto more_frequent = [](auto& a, auto& b){ return a.second > b.second; };
+        std::stable_sort(counts.begin(), counts.end(), more_frequent); // partial_sort would not keep first-seen order
+        if(top_k != 0 && top_k < counts.size())
+            counts.resize(top_k);
+
+        return counts;
+    }
+
+    /**
+     * Switches a column to dictionary encoding, see StringColumn. This changes the storage shared by every view of the
+     * table, so it should be done before views are handed out.
+     * @param col_i the index of the column
+     */
+    void dictionary_encode(const std::size_t col_i) { table->columns[col_i].encode(); }
+
+    /**
+     * Builds a secondary index over a column of the table, unless one exists already. The index is cached with the
+     * table, so every view of it uses the index from then on: subsetter2 on the whole table returns the index entry
+     * directly, and on a view in file order it intersects the entry with the view's rows.
+     * @param col_i the index of the column
+     * @return the index
+     */
+    auto build_index(const std::size_t col_i) const -> std::shared_ptr<const EqualityIndex> {
+        std::lock_guard lock(table->index_mtx);
+        auto& idx = table->indexes[col_i];
+        if(!idx) {
+            auto built = std::make_shared<EqualityIndex>();
+            auto& col = column(col_i);
+            for(std::size_t r{0}; r < table->n_rows; r++)
+                built->rows_of[col[r]].push_back(r);
+            idx = std::move(built);
+        }
+        return idx;
+    }
+
+    /**
+     * @param col_i the index of a column
+     * @return the cached index over the column, or nullptr if build_index was never called for it
+     */
+    auto find_index(const std::size_t col_i) const -> std::shared_ptr<const EqualityIndex> {
+        std::lock_guard lock(table->index_mtx);
+        auto it = table->indexes.find(col_i);
+        return it == table->indexes.end() ? nullptr : it->second;
+    }
+
+    /**
+     * Creates a view of some rows of the table behind this object. No cell is copied.
+     * @param table_rows the table rows (see rows()) the view selects, in order
+     * @return a view sharing this object's table
+     */
+    FlatFile subset_rows(rows_t table_rows) const {
+        return FlatFile(table, std::make_shared<const rows_t>(std::move(table_rows)), index_of);
+    }
+
     /**
      * Creates a smaller version of this object based on some conditions
      * @param name_idx the name of the column that will be matched for a value
      * @param col_value the value that column at name_idx must have for subsetting
-     * @return a smaller version of this object where col at name_idx matches a value
+     * @return a view of the rows of this object where col at name_idx matches a value
      */
-    FlatFile subsetter2(const std::size_t name_idx, const std::string& col_value){
-        return FlatFile(header, trim(name_idx, col_value));
+    FlatFile subsetter2(const std::size_t name_idx, const std::string& col_value) const {
+        return subset_rows(trim(name_idx, col_value));
     }
 
 
-    std::vector<a_row> trim(const std::size_t name_idx, const std::string& col_value){
+    /**
+     * The rows sharing one combination of values in the grouped columns, see group_by.
+     */
+    struct Group{
+
+        a_row  key ; // the value of every grouped column, in the order the columns were given
+        rows_t rows; // the table rows (see rows()) of the group, in the order of this view
+    };
 
-        std::vector<a_row> new_data;
-        for(auto& gwas_entry : data)
-            if(gwas_entry[name_idx] == col_value)
-                new_data.push_back(gwas_entry);
+    /**
+     * Splits the rows of this view by the values they hold in some columns, in a single pass. Encoded columns are
+     * keyed by their dictionary codes; plain columns are interned first, so every key is a tuple of integers.
+     * @param cols the indexes of the columns to group by
+     * @return one group per distinct combination of values, in the order the combinations first occur
+     */
+    [[nodiscard]] std::vector<Group> group_by(const std::vector<std::size_t>& cols) const {
+
+        // code of every row of this view in every grouped column
+        std::vector<std::vector<std::uint32_t>> codes(cols.size());
+        std::vector<const Dictionary*>          dicts(cols.size());
+        std::vector<Dictionary>                 local(cols.size());
+        for(std::size_t k{0}; k < cols.size(); k++) {
+            auto& col = column(cols[k]);
+            codes[k].reserve(num_rows());
+            if(col.encoded()) {
+                auto col_codes = col.code_values();
+                for(auto r : rows())
+                    codes[k].push_back(col_codes[r]);
+                dicts[k] = &col.dict();
+            }
+            else {
+                for(auto r : rows())
+                    codes[k].push_back(local[k].intern(col[r]));
+                dicts[k] = &local[k];
+            }
+        }
 
-        return new_data;
+        std::vector<Group> groups;
+        auto ensure_group = [&](std::size_t i, std::size_t g) -> std::size_t { // creates group g for row i if it is new
+            if(g == groups.size()) {
+                Group grp;
+                for(std::size_t k{0}; k < cols.size(); k++)
+                    grp.key.push_back(dicts[k]->values[codes[k][i]]);
+                groups.push_back(std::move(grp));
+            }
+            return g;
+        };
+
+        if(cols.size() == 1) { // codes are dense, so a plain lookup table finds the group
+            std::vector<std::size_t> group_of_code(dicts[0]->size(), std::numeric_limits<std::size_t>::max());
+            for(std::size_t i{0}; i < num_rows(); i++) {
+                auto& g = group_of_code[codes[0][i]];
+                if(g == std::numeric_limits<std::size_t>::max())
+                    g = groups.size();
+                groups[ensure_group(i, g)].rows.push_back(row_id(i));
+            }
+        }
+        else {
+            std::unordered_map<std::u32string, std::size_t> group_of_key;
+            std::u32string key(cols.size(), U'\0');
+            for(std::size_t i{0}; i < num_rows(); i++) {
+                for(std::size_t k{0}; k < cols.size(); k++)
+                    key[k] = codes[k][i];
+                auto it = group_of_key.try_emplace(key, groups.size()).first;
+                groups[ensure_group(i, it->second)].rows.push_back(row_id(i));
+            }
+        }
+
+        return groups;
+    }
+
+    /**
+     * @param name_idx the index of the column that will be matched for a value
+     * @param col_value the value that column at name_idx must have
+     * @return the table rows of this view whose column at name_idx matches the value
+     */
+    rows_t trim(const std::size_t name_idx, const std::string& col_value) const {
+
+        rows_t matches;
+        if(auto index = find_index(name_idx); index && (is_whole_table() || ascending)) {
+            auto postings = index->find(col_value);
+            if(!postings)
+                return matches;
+            if(is_whole_table())
+                return *postings;
+
+            // both lists are increasing: walk the shorter one and binary search the longer one
+            auto& sel = rows();
+            auto& shorter = postings->size() < sel.size() ? *postings : sel;
+            auto& longer  = postings->size() < sel.size() ? sel : *postings;
+            for(auto r : shorter)
+                if(std::binary_search(longer.begin(), longer.end(), r))
+                    matches.push_back(r);
+            return matches;
+        }
+
+        auto& col = column(name_idx);
+        if(col.encoded()) { // one dictionary lookup, then integer compares
+            auto code = col.dict().find(col_value);
+            if(!code)
+                return matches;
+            auto codes = col.code_values();
+            for(auto r : rows())
+                if(codes[r] == *code)
+                    matches.push_back(r);
+        }
+        else
+            for(auto r : rows())
+                if(col[r] == col_value)
+                    matches.push_back(r);
+
+        return matches;
     }
 };
 
 /**
- * The purpose of this class is to provider an interface to all GWAS results in the GWAS catalog.
+ * Typed descriptions of GWAS catalog columns for GWAS::extract. A description names a column and the type its cells
+ * are parsed as; other columns can be described the same way.
  */
-class GWAS{
+namespace gwas_col {
 
-    using gwas_entry = std::vector<std::string>;
+    struct Position       { static constexpr const char* name = "CHR_POS"              ; using type = std::uint64_t; };
+    struct EffectSize     { static constexpr const char* name = "OR or BETA"           ; using type = double       ; };
+    struct PValue         { static constexpr const char* name = "P-VALUE"              ; using type = double       ; };
+    struct MinusLog10P    { static constexpr const char* name = "PVALUE_MLOG"          ; using type = double       ; };
+    struct RiskAlleleFreq { static constexpr const char* name = "RISK ALLELE FREQUENCY"; using type = double       ; };
+}
+
+/**
+ * Struct-of-arrays result of GWAS::extract: one vector per requested column, all the same length.
+ * @tparam Cols column descriptions, see gwas_col
+ */
+template<typename... Cols>
+struct Extracted{
+
+    std::vector<std::size_t>                        rows   ; // the table row each entry came from
+    std::tuple<std::vector<typename Cols::type>...> columns; // the values, in the order of Cols
+
+    [[nodiscard]] auto size() const { return rows.size(); }
+
+    /**
+     * @tparam Col one of Cols
+     * @return the values of that column
+     */
+    template<typename Col>
+    [[nodiscard]] auto get() const -> const std::vector<typename Col::type>& {
+        return std::get<position_of<Col>()>(columns);
+    }
 
 private:
 
+    template<typename Col>
+    static constexpr std::size_t position_of() {
+        constexpr bool match[] = {std::is_same_v<Col, Cols>...};
+        std::size_t i{0};
+        while(i < sizeof...(Cols) && !match[i])
+            i++;
+        static_assert(((std::is_same_v<Col, Cols>) || ...), "column was not extracted");
+        return i;
+    }
+};
+
+/**
+ * A genomic interval on one chromosome, both ends included.
+ */
+struct Region{
+
+    std::string   chr;   // as written in the CHR_ID column, e.g. "6" or "X"
+    std::uint64_t start{0};
+    std::uint64_t end  {0};
+};
+
+/**
+ * Per-chromosome lists of (position, table row), sorted by position, over the associations of one view that have a
+ * valid position. A region query is two binary searches and a copy of the k rows in between.
+ */
+class PositionIndex{
+
+    struct Entry{
+
+        std::uint64_t pos;
+        std::size_t   row;
+    };
+
+    std::unordered_map<std::string_view, std::vector<Entry>> by_chr;
+
+public:
+
     /**
-     * Returns index of of parseable value in the GWAS object. Not all positions are valid. Some are missing or do not
-     * resolve to valid numbers.
-     * @return vector holding a vector of valid positions.
+     * @param file the view to index
+     * @param chr_col the index of the chromosome column
+     * @param pos_col the index of the position column
      */
+    PositionIndex(const FlatFile& file, std::size_t chr_col, std::size_t pos_col){
+        auto& chrs    = file.column(chr_col);
+        auto position = file.numeric_reader<std::uint64_t>(pos_col);
+        for(auto r : file.rows())
+            if(auto pos = position(r))
+                by_chr[chrs[r]].push_back({*pos, r});
+        for(auto& [chr, entries] : by_chr)
+            std::sort(entries.begin(), entries.end(), [](auto& a, auto& b){ return a.pos < b.pos || (a.pos == b.pos && a.row < b.row); });
+    }
 
     /**
-     * Returns index of of parseable value in the GWAS object.
-     * @tparam SomeFunction A function that returns either a value that is parsed (e.g., int, double, etc.) or nan
-     * @param col_name the column in the data that will be parsed
-     * @param f Determines if the object is parseable. It will return nan if it is not or the right value if it can be parsed.
-     * @return A vector of index positions of all parseable values of interest
+     * @param region the interval to look up
+     * @return the table rows inside the interval, ordered by position
      */
-    template<typename SomeFunction>
-    auto grab_mask(const std::size_t idx, SomeFunction f)
-    {
-        std::vector<std::size_t> mask_pos;
-        for(std::size_t i{0}; i < file.num_rows(); i++)
-            if(!std::isnan(f(file.cell(i,idx)))) // data[i] is a gwas_entry, data[i][idx] is a value in a gwas entry
-                mask_pos.emplace_back(i);
+    [[nodiscard]] std::vector<std::size_t> query(const Region& region) const {
+        std::vector<std::size_t> rows;
+        auto it = by_chr.find(region.chr);
+        if(it == by_chr.end() || region.end < region.start)
+            return rows;
+
+        auto& entries = it->second;
+        auto first = std::lower_bound(entries.begin(), entries.end(), region.start, [](auto& e, auto pos){ return e.pos < pos; });
+        auto last  = std::upper_bound(first, entries.end(), region.end, [](auto pos, auto& e){ return pos < e.pos; });
+        rows.reserve(static_cast<std::size_t>(last - first));
+        for(; first != last; ++first)
+            rows.push_back(first->row);
+        return rows;
+    }
+};
+
+/**
+ * The purpose of this class is to provider an interface to all GWAS results in the GWAS catalog.
+ */
+class GWAS{
 
-        return mask_pos;
+private:
+
+    /**
+     * The position index of this object, built on the first region query. Copies of this object share it, since they
+     * hold the same associations; subsets start without one.
+     */
+    struct LazyPositionIndex{
+
+        std::mutex                           mtx;
+        std::shared_ptr<const PositionIndex> index;
+    };
+
+    std::shared_ptr<LazyPositionIndex> position_index = std::make_shared<LazyPositionIndex>();
+
+    auto positionIndex() const -> std::shared_ptr<const PositionIndex>
+    {
+        std::lock_guard lock(position_index->mtx);
+        if(!position_index->index)
+            position_index->index = std::make_shared<const PositionIndex>(file, file.index_of.at("CHR_ID"), file.index_of.at("CHR_POS"));
+        return position_index->index;
     }
 
-    [[nodiscard]] gwas_entry& ith_gwas(std::size_t i) {
-        return file.ith_row(i);
+    template<typename... Cols, std::size_t... I>
+    auto extract_impl(std::index_sequence<I...>) const {
+
+        std::tuple readers{file.numeric_reader<typename Cols::type>(file.index_of.at(Cols::name))...};
+
+        Extracted<Cols...> out;
+        out.rows.reserve(size());
+        (std::get<I>(out.columns).reserve(size()), ...);
+        for(auto r : file.rows()) {
+            std::tuple values{std::get<I>(readers)(r)...};
+            if((std::get<I>(values).has_value() && ...)) {
+                out.rows.push_back(r);
+                (std::get<I>(out.columns).push_back(*std::get<I>(values)), ...);
+            }
+        }
+
+        return out;
     }
 
 public:
@@ -241,11 +1463,26 @@ public:
     explicit GWAS(FlatFile&& f) : file(std::move(f)){}
 
 
+    /**
+     * The load options used for the GWAS catalog unless others are given. The dictionary columns hold a few thousand
+     * distinct values repeated over all associations, so they are dictionary encoded. Position and effect size are
+     * parsed once at load, since every analysis needs them.
+     */
+    static LoadOptions catalogOptions()
+    {
+        LoadOptions options;
+        options.dictionary_columns = {"DISEASE/TRAIT", "CHR_ID", "CONTEXT", "MAPPED_GENE", "STUDY ACCESSION"};
+        options.integer_columns    = {"CHR_POS"};
+        options.real_columns       = {"OR or BETA"};
+        return options;
+    }
+
     /**
      * Instantiates a GWAS object from the file location of the GWAS catalog
      * @param file the path to the GWAS catalog TSV file
+     * @param options how the catalog columns are stored
      */
-    explicit GWAS(const std::string& file_nm) : file(FlatFile(file_nm)){}
+    explicit GWAS(const std::string& file_nm, const LoadOptions& options = catalogOptions()) : file(FlatFile(file_nm, options)){}
 
     /**
      * The number of GWAS entries in this object.
@@ -264,22 +1501,17 @@ public:
 
     /**
      * Get all diseases in this GWAS object.
+     * @param sorted true to sort the diseases, false to keep them in the order they first occur
      * @return List of all diseases in this GWAS object.
      */
-    [[nodiscard]] auto uniqueDiseases()
+    [[nodiscard]] auto uniqueDiseases(bool sorted = false) const
     {
-        return file.unique_col(file.index_of.at("DISEASE/TRAIT"));
+        return file.unique_col(file.index_of.at("DISEASE/TRAIT"), sorted);
     }
 
     void printSummary()
     {
-        std::size_t cnt{0};
-        for(auto& disease : this->uniqueDiseases())
-        {
-            auto dis = this->subsetter("DISEASE/TRAIT", disease);
-            if(dis.size() > 9)
-                cnt++;
-        }
+        auto cnt = this->value_counts("DISEASE/TRAIT", 0, 10).size();
 
         std::cout << "associations: " << this->size() << "\tdiseases > 9 " << cnt << std::endl;
 
@@ -287,29 +1519,146 @@ public:
     }
 
 
-    GWAS subsetter(const std::string& col_nm, const std::string& col_value) {
+    /**
+     * Selects the associations whose column col_nm equals col_value. The result is a view sharing this object's data,
+     * so chained calls such as subsetter("DISEASE/TRAIT", d).subsetter("CHR_ID", c) never copy associations.
+     * @param col_nm the name of the column to match
+     * @param col_value the value to match
+     * @return a view of the matching associations
+     */
+    GWAS subsetter(const std::string& col_nm, const std::string& col_value) const {
 
         return GWAS(file.subsetter2(file.index_of.at(col_nm), col_value));
     }
 
     /**
-     * Retrieves the position and effect size of all associations in this object. This function returns all positions
-     * and effect size info, even if there are multople diseases and multiple chromosomes mixed into the data of this
-     * object.
-     * @return position and effect size contents of this object. It only returns cases where both the effect size and
-     * position are valid numbers.
+     * Selects the associations inside a genomic interval, e.g. region("6", 28'000'000, 34'000'000) for the MHC. The
+     * first call builds a per-chromosome position index of this object; after that a query costs O(log n + k).
+     * Associations without a valid position are never returned.
+     * @param chr the chromosome, as written in CHR_ID
+     * @param start the first position of the interval
+     * @param end the last position of the interval
+     * @return a view of the associations in the interval, ordered by position
+     */
+    GWAS region(const std::string& chr, std::uint64_t start, std::uint64_t end) const
+    {
+        return GWAS(file.subset_rows(positionIndex()->query({chr, start, end})));
+    }
+
+    /**
+     * Answers many region queries against one position index, in parallel.
+     * @param regions the intervals to look up
+     * @return a view per interval, in the order of regions
+     */
+    std::vector<GWAS> regions(const std::vector<Region>& regions) const
+    {
+        auto index = positionIndex();
+        std::vector<std::vector<std::size_t>> rows(regions.size());
+        parallel_for(regions.size(), [&](std::size_t i){ rows[i] = index->query(regions[i]); });
+
+        std::vector<GWAS> views;
+        views.reserve(regions.size());
+        for(auto& r : rows)
+            views.emplace_back(file.subset_rows(std::move(r)));
+        return views;
+    }
+
+    /**
+     * Builds a secondary index over a column, so subsetter on that column only touches the matching associations
+     * instead of scanning every one. The index is shared by this object and every object subset from the same file.
+     * Worth it for columns that are filtered on repeatedly, such as "DISEASE/TRAIT", "CHR_ID", "SNPS" or "MAPPED_GENE".
+     * @param col_nm the name of the column
+     */
+    void index(const std::string& col_nm) const
+    {
+        file.build_index(file.index_of.at(col_nm));
+    }
+
+    /**
+     * Counts the associations per value of a column, e.g. per disease, chromosome or study.
+     * @param col_nm the name of the column
+     * @param top_k keep only the k most frequent values, 0 to keep all
+     * @param min_count drop values with fewer associations than this
+     * @return (value, associations) pairs, most frequent first
+     */
+    [[nodiscard]] auto value_counts(const std::string& col_nm, std::size_t top_k = 0, std::size_t min_count = 1) const
+        -> std::vector<std::pair<std::string_view, std::size_t>>
+    {
+        return file.value_counts(file.index_of.at(col_nm), top_k, min_count);
+    }
+
+    /**
+     * Splits the associations in this object by the values of one or more columns in a single pass over the data.
+     * Each group is a view, so it can be subset, summarized or grouped again without copying associations.
+     * @param col_nms the names of the columns to group by, e.g. "DISEASE/TRAIT", "CHR_ID"
+     * @return (key, associations) for every distinct combination of values, in the order they first occur. The key
+     * holds one value per grouping column.
      */
-    auto positions_and_effect_size() {
+    template<typename... Names>
+    [[nodiscard]] auto group_by(const Names&... col_nms) const -> std::vector<std::pair<std::vector<std::string_view>, GWAS>> {
+
+        std::vector<std::pair<std::vector<std::string_view>, GWAS>> groups;
+        for(auto& g : file.group_by({file.index_of.at(col_nms)...}))
+            groups.emplace_back(std::move(g.key), GWAS(file.subset_rows(std::move(g.rows))));
+
+        return groups;
+    }
 
-        std::vector<std::pair<unsigned long, double>> pe;
-        for (auto i : intersect<unsigned long>(grab_mask(file.index_of.at("CHR_POS"), parser<unsigned long>), grab_mask(file.index_of.at("OR or BETA"), parser<double>))) {
-            auto &gwas_entry = this->ith_gwas(i);
-            auto a_pos        = boost::lexical_cast<unsigned long>(gwas_entry[file.index_of.at("CHR_POS")]);
-            auto effect_size  = boost::lexical_cast<double       >(gwas_entry[file.index_of.at("OR or BETA")]);
-            pe.emplace_back(a_pos, effect_size);
+    /**
+     * Retrieves the value of two numeric columns for all associations in this object, in one pass. Every cell is
+     * parsed at most once (not at all for a column parsed at load) and the pairs are written straight into the
+     * result, which is sized for every association up front.
+     * @tparam A the type of the first column, e.g. unsigned long for "CHR_POS"
+     * @tparam B the type of the second column, e.g. double for "OR or BETA"
+     * @param col_a the name of the first column
+     * @param col_b the name of the second column
+     * @return (a, b) for every association where both values are valid numbers, in the order of this object
+     */
+    template<typename A, typename B>
+    auto numeric_pairs(const std::string& col_a, const std::string& col_b) const {
+
+        auto read_a = file.numeric_reader<A>(file.index_of.at(col_a));
+        auto read_b = file.numeric_reader<B>(file.index_of.at(col_b));
+
+        std::vector<std::pair<A, B>> pairs;
+        pairs.reserve(size());
+        for(auto r : file.rows())
+            if(auto a = read_a(r))
+                if(auto b = read_b(r))
+                    pairs.emplace_back(*a, *b);
+
+        return pairs;
+    }
+
+    /**
+     * Retrieves the value of any number of numeric columns for all associations in this object, in one pass.
+     * @param col_nms the names of the columns
+     * @return one vector per column, all the same length, holding the values of the associations where every column
+     * is a valid number
+     */
+    auto numeric_columns(const std::vector<std::string>& col_nms) const {
+
+        std::vector<NumericReader<double>> readers;
+        for(auto& nm : col_nms)
+            readers.push_back(file.numeric_reader<double>(file.index_of.at(nm)));
+
+        std::vector<std::vector<double>> cols(col_nms.size());
+        for(auto& c : cols)
+            c.reserve(size());
+        std::vector<double> row(col_nms.size());
+        for(auto r : file.rows()) {
+            bool all_valid{true};
+            for(std::size_t k{0}; k < readers.size() && all_valid; k++)
+                if(auto v = readers[k](r))
+                    row[k] = *v;
+                else
+                    all_valid = false;
+            if(all_valid)
+                for(std::size_t k{0}; k < cols.size(); k++)
+                    cols[k].push_back(row[k]);
         }
 
-        return pe;
+        return cols;
     }
 
     /**
@@ -319,30 +1668,38 @@ public:
      * @return position and effect size contents of this object. It only returns cases where both the effect size and
      * position are valid numbers.
      */
-//    template<int a, typename partner>
-//    auto positions_and_X() {
-//
-//        if (a == 1)
-//            std::cout << "3" << std::endl;
-//
-//        std::vector<std::pair<unsigned long, partner>> pe;
-//        for (auto i : intersect<unsigned long>(grab_mask(file->pos_i, parser<unsigned long>), grab_mask(file->es_i, parser<double>))) { // for every entry with a valid position and effect size
-//            auto &gwas_entry = this->ith_gwas(i);//file->data[i];
-//            auto a_pos        = boost::lexical_cast<unsigned long>(gwas_entry[file->pos_i]);
-//            auto effect_size  = boost::lexical_cast<double       >(gwas_entry[file->es_i ]);
-//            pe.emplace_back(a_pos, effect_size);
-//        }
-//
-//        return pe;
-//    }
+    auto positions_and_effect_size() const {
+        return numeric_pairs<unsigned long, double>("CHR_POS", "OR or BETA");
+    }
+
+    /**
+     * Retrieves several typed columns for all associations in this object, in one pass. Column names are resolved once
+     * before the scan and every cell is parsed at most once, e.g.
+     * extract<gwas_col::Position, gwas_col::MinusLog10P>() for position and -log10 p-value.
+     * @tparam Cols column descriptions, see gwas_col
+     * @return the values of the associations where every requested column is valid, as a struct of arrays
+     */
+    template<typename... Cols>
+    auto extract() const {
+        return extract_impl<Cols...>(std::index_sequence_for<Cols...>{});
+    }
 
     /**
      * Get all unique RSIDs in this GWAS object.
+     * @param sorted true to sort the RSIDs, false to keep them in the order they first occur
      * @return List of all RSIDs in this GWAS object.
      */
-    [[nodiscard]] auto uniqueRSIDs()
+    [[nodiscard]] auto uniqueRSIDs(bool sorted = false) const
+    {
+        return file.unique_col(file.index_of.at("SNPS"), sorted);
+    }
+
+    /**
+     * @return the number of distinct RSIDs in this GWAS object
+     */
+    [[nodiscard]] auto numUniqueRSIDs() const
     {
-        return file.unique_col(file.index_of.at("SNPS"));
+        return file.count_distinct(file.index_of.at("SNPS"));
     }
 
 };
@@ -0,0 +1,152 @@
+#include <algorithm>
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "GWAS.hxx"
+#include "Parallel.hxx"
+#include "PolygenicScore.hxx"
+
+//
+// Risk scores of many traits at once.
+//
+
+#ifndef GEN_RISK2_MULTITRAITSCORE_HXX
+#define GEN_RISK2_MULTITRAITSCORE_HXX
+
+/**
+ * Scores of every sample for every trait, stored sample-major.
+ */
+struct TraitScores{
+
+    std::size_t        n_samples{0};
+    std::size_t        n_traits {0};
+    std::vector<float> scores; // score of trait t in sample s at s * n_traits + t
+
+    TraitScores(std::size_t samples, std::size_t traits)
+        : n_samples(samples), n_traits(traits), scores(samples * traits, 0.0f){}
+
+    [[nodiscard]] const float* sample(std::size_t s) const { return scores.data() + s * n_traits; }
+};
+
+/**
+ * One polygenic score per trait, applied together. The weights form a sparse variant x trait matrix: a variant only
+ * has weights for the few traits it is associated with. Scoring multiplies a cohort's dosage matrix by it in a single
+ * pass, so a thousand traits cost about as much as reading the genotypes once instead of a thousand times.
+ */
+class MultiTraitScore{
+
+    static constexpr std::size_t trait_block {1024}; // traits whose scores are accumulated at a time, 4 KB per sample
+    static constexpr std::size_t sample_chunk{64};   // samples handed to a thread at a time
+
+    /**
+     * The weights of one block of traits in compressed sparse rows: the variants with a weight in the block, and for
+     * each of them its run of (trait, weight) entries.
+     */
+    struct Block{
+
+        std::size_t                first_trait{0};
+        std::vector<std::uint32_t> variants;    // columns of the dosage matrix with a weight in this block
+        std::vector<std::uint32_t> start{0};    // entries of variants[i] are [start[i], start[i + 1])
+        std::vector<std::uint32_t> traits;      // trait of every entry, relative to first_trait
+        std::vector<float>         weights;     // weight of every entry
+    };
+
+    std::vector<Block> blocks;
+
+public:
+
+    std::vector<std::string> traits; // the scored traits, in the order of the scores
+    PolygenicScore           panel;  // every weighted variant, the columns of the dosage matrices read; its own weights are unused
+
+    /**
+     * Builds one PolygenicScore per DISEASE/TRAIT group of a set of associations (see PolygenicScore for how weights
+     * are chosen) and merges their variants into one panel. Variants are told apart by rsID and risk allele, since a
+     * dosage depends on both. Traits left without any usable weight are dropped.
+     * @param associations the associations to take the weights from, e.g. the whole catalog
+     */
+    explicit MultiTraitScore(const GWAS& associations)
+    {
+        struct Entry{ std::uint32_t variant; std::uint32_t trait; float weight; };
+        std::vector<Entry> entries;
+        std::unordered_map<std::string, std::uint32_t> variant_of; // rsID and risk allele -> column
+
+        for(auto& [key, group] : associations.group_by("DISEASE/TRAIT")) {
+            PolygenicScore trait_score(group);
+            if(trait_score.variants.empty())
+                continue;
+            auto t = static_cast<std::uint32_t>(traits.size());
+            traits.emplace_back(key[0]);
+            for(auto& v : trait_score.variants) {
+                auto [it, added] = variant_of.try_emplace(v.rsid + "-" + v.allele, static_cast<std::uint32_t>(panel.variants.size()));
+                if(added) {
+                    panel.variants.push_back(v);
+                    panel.variants.back().weight = 0;
+                }
+                entries.push_back({it->second, t, static_cast<float>(v.weight)});
+            }
+        }
+
+        std::sort(entries.begin(), entries.end(), [](const Entry& a, const Entry& b){
+            return std::pair(a.trait / trait_block, a.variant) < std::pair(b.trait / trait_block, b.variant);
+        });
+        for(auto& e : entries) {
+            auto first = e.trait / trait_block * trait_block;
+            if(blocks.empty() || blocks.back().first_trait != first) {
+                blocks.emplace_back();
+                blocks.back().first_trait = first;
+            }
+            auto& b = blocks.back();
+            if(b.variants.empty() || b.variants.back() != e.variant) {
+                if(!b.variants.empty())
+                    b.start.push_back(static_cast<std::uint32_t>(b.traits.size()));
+                b.variants.push_back(e.variant);
+            }
+            b.traits .push_back(static_cast<std::uint32_t>(e.trait - first));
+            b.weights.push_back(e.weight);
+        }
+        for(auto& b : blocks)
+            b.start.push_back(static_cast<std::uint32_t>(b.traits.size()));
+    }
+
+    /**
+     * Scores a cohort for every trait. Samples are split into chunks scored in parallel. Within a chunk the traits are
+     * taken a block at a time, so the scores being accumulated for a sample stay in L1 cache while the block's sparse
+     * weights, shared by all samples of the chunk, stay in L2; each sample then walks its dosages once per block and
+     * skips the variants it does not carry.
+     * @param cohort dosages with one column per variant of panel, e.g. from VcfReader::read(panel)
+     * @param threads the most threads to use, 0 for one per hardware thread
+     * @return the score of every sample for every trait
+     */
+    [[nodiscard]] TraitScores score(const DosageMatrix& cohort, unsigned threads = 0) const
+    {
+        if(cohort.n_variants != panel.variants.size())
+            throw std::runtime_error("dosage matrix has " + std::to_string(cohort.n_variants) + " variants, panel has "
+                                     + std::to_string(panel.variants.size()));
+
+        TraitScores out(cohort.n_samples, traits.size());
+        auto n_chunks = (cohort.n_samples + sample_chunk - 1) / sample_chunk;
+        parallel_for(n_chunks, [&](std::size_t c){
+            auto first = c * sample_chunk;
+            auto last  = std::min(first + sample_chunk, cohort.n_samples);
+            for(auto& b : blocks)
+                for(auto s = first; s < last; s++) {
+                    auto dosages = cohort.sample(s);
+                    auto acc     = out.scores.data() + s * out.n_traits + b.first_trait;
+                    for(std::size_t i{0}; i < b.variants.size(); i++) {
+                        auto d = dosages[b.variants[i]];
+                        if(d == 0)
+                            continue;
+                        for(auto e = b.start[i]; e < b.start[i + 1]; e++)
+                            acc[b.traits[e]] += d * b.weights[e];
+                    }
+                }
+        }, threads);
+        return out;
+    }
+};
+
+#endif //GEN_RISK2_MULTITRAITSCORE_HXX
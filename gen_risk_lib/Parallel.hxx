@@ -0,0 +1,73 @@
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+//
+// Helpers for spreading independent pieces of work over threads.
+//
+
+#ifndef GEN_RISK2_PARALLEL_HXX
+#define GEN_RISK2_PARALLEL_HXX
+
+/**
+ * The number of threads parallel work uses unless told otherwise.
+ * @return the number of hardware threads, at least 1
+ */
+inline unsigned default_threads(){
+    return std::max(1u, std::thread::hardware_concurrency());
+}
+
+/**
+ * Calls fn(i) for every i in [0, n), spread over a pool of up to `threads` threads (the calling thread included).
+ * Indexes are handed out one at a time, so pieces of uneven size balance themselves. Blocks until every call has
+ * returned. If a call throws, no further indexes are handed out and the first exception is rethrown.
+ * @param n the number of pieces of work
+ * @param fn called once with the index of every piece
+ * @param threads the most threads to use, 0 for default_threads()
+ */
+template<typename Fn>
+void parallel_for(std::size_t n, Fn&& fn, unsigned threads = 0)
+{
+    if(threads == 0)
+        threads = default_threads();
+    threads = static_cast<unsigned>(std::min<std::size_t>(threads, n));
+
+    if(threads <= 1) {
+        for(std::size_t i{0}; i < n; i++)
+            fn(i);
+        return;
+    }
+
+    std::atomic<std::size_t> next{0};
+    std::exception_ptr       error;
+    std::mutex               error_mtx;
+
+    auto work = [&]() {
+        for(std::size_t i; (i = next++) < n; ) {
+            try {
+                fn(i);
+            }
+            catch(...) {
+                std::lock_guard lock(error_mtx);
+                if(!error)
+                    error = std::current_exception();
+                next = n;
+            }
+        }
+    };
+
+    {
+        std::vector<std::jthread> pool;
+        for(unsigned t{1}; t < threads; t++)
+            pool.emplace_back(work);
+        work();
+    } // jthreads join here
+
+    if(error)
+        std::rethrow_exception(error);
+}
+
+#endif //GEN_RISK2_PARALLEL_HXX
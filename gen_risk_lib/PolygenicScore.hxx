@@ -0,0 +1,231 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#if defined(__AVX2__) && defined(__FMA__)
+#include <immintrin.h>
+#endif
+
+#include "GWAS.hxx"
+#include "Parallel.hxx"
+
+//
+// Polygenic risk scores from the effect sizes of a set of associations.
+//
+
+#ifndef GEN_RISK2_POLYGENICSCORE_HXX
+#define GEN_RISK2_POLYGENICSCORE_HXX
+
+/**
+ * Risk allele dosages of a cohort, stored sample-major: the dosages of one sample are contiguous, one per variant of
+ * the score they were read for. A dosage counts copies of the risk allele, from 0 to 2.
+ */
+struct DosageMatrix{
+
+    std::size_t        n_samples {0};
+    std::size_t        n_variants{0};
+    std::vector<float> dosages; // dosage of variant v in sample s at s * n_variants + v
+
+    DosageMatrix() = default;
+
+    DosageMatrix(std::size_t samples, std::size_t variants)
+        : n_samples(samples), n_variants(variants), dosages(samples * variants, 0.0f){}
+
+    [[nodiscard]] float*       sample(std::size_t s)       { return dosages.data() + s * n_variants; }
+    [[nodiscard]] const float* sample(std::size_t s) const { return dosages.data() + s * n_variants; }
+};
+
+/**
+ * A polygenic risk score: a weight per variant, applied to the dosage of its risk allele and summed over variants.
+ */
+class PolygenicScore{
+
+    static constexpr std::size_t variant_block{4096}; // weights scored at a time, 16 KB of floats that stay in L1
+    static constexpr std::size_t sample_tile  {4};    // samples sharing each load of the weights
+    static constexpr std::size_t sample_chunk {256};  // samples handed to a thread at a time
+
+    /**
+     * Adds the dot products of up to sample_tile dosage rows with weights[begin, end) to out.
+     * @param rows the first dosage of every row
+     * @param n the number of rows
+     */
+    static void score_tile(const float* const* rows, std::size_t n, const float* weights, std::size_t begin,
+                           std::size_t end, double* out)
+    {
+        std::size_t v{begin};
+#if defined(__AVX2__) && defined(__FMA__)
+        if(n == sample_tile) {
+            __m256 acc[sample_tile] = {_mm256_setzero_ps(), _mm256_setzero_ps(), _mm256_setzero_ps(), _mm256_setzero_ps()};
+            for(; v + 8 <= end; v += 8) {
+                __m256 w = _mm256_loadu_ps(weights + v);
+                for(std::size_t k{0}; k < sample_tile; k++)
+                    acc[k] = _mm256_fmadd_ps(_mm256_loadu_ps(rows[k] + v), w, acc[k]);
+            }
+            for(std::size_t k{0}; k < sample_tile; k++) {
+                alignas(32) float lanes[8];
+                _mm256_store_ps(lanes, acc[k]);
+                double sum{0};
+                for(auto lane : lanes)
+                    sum += lane;
+                out[k] += sum;
+            }
+        }
+#endif
+        for(std::size_t k{0}; k < n; k++) {
+            double sum{0};
+            for(auto i = v; i < end; i++)
+                sum += static_cast<double>(rows[k][i]) * weights[i];
+            out[k] += sum;
+        }
+    }
+
+public:
+
+    /**
+     * One weighted variant of the score.
+     */
+    struct Variant{
+
+        std::string   rsid;
+        std::string   chr;
+        std::uint64_t pos   {0}; // 0 if the catalog gives no position
+        std::string   allele;    // the risk allele, whose dosage the weight applies to
+        double        weight{0}; // log of the odds ratio
+    };
+
+    std::vector<Variant> variants; // the columns of the dosage matrices this score reads, in order
+
+    PolygenicScore() = default;
+
+    /**
+     * Takes the weights from a set of associations, e.g. those of one disease. Every association with a single rsID in
+     * SNPS, a known risk allele in STRONGEST SNP-RISK ALLELE and an odds ratio above 0 in OR or BETA gives the weight
+     * log(OR) to that allele. A variant reported more than once keeps its association with the smallest P-VALUE.
+     * @param associations the associations to take the weights from
+     */
+    explicit PolygenicScore(const GWAS& associations)
+    {
+        auto& file    = associations.file;
+        auto& snps    = file.column(file.index_of.at("SNPS"));
+        auto& alleles = file.column(file.index_of.at("STRONGEST SNP-RISK ALLELE"));
+        auto& chrs    = file.column(file.index_of.at("CHR_ID"));
+        auto  pos     = file.numeric_reader<gwas_col::Position::type  >(file.index_of.at(gwas_col::Position::name));
+        auto  effect  = file.numeric_reader<gwas_col::EffectSize::type>(file.index_of.at(gwas_col::EffectSize::name));
+        auto  p_value = file.numeric_reader<gwas_col::PValue::type    >(file.index_of.at(gwas_col::PValue::name));
+
+        std::unordered_map<std::string_view, std::size_t> variant_of; // rsID -> index in variants
+        std::vector<double> best_p;
+        for(auto r : file.rows()) {
+            auto rsid   = snps[r];
+            auto allele = risk_allele_of(alleles[r]);
+            auto odds   = effect(r);
+            if(!rsid.starts_with("rs") || rsid.find_first_of(" ,;") != std::string_view::npos || allele.empty()
+               || !odds || *odds <= 0)
+                continue;
+
+            auto p = p_value(r).value_or(1.0);
+            auto [it, added] = variant_of.try_emplace(rsid, variants.size());
+            if(!added && p >= best_p[it->second])
+                continue;
+            Variant v{std::string(rsid), std::string(chrs[r]), pos(r).value_or(0), std::string(allele), std::log(*odds)};
+            if(added) {
+                variants.push_back(std::move(v));
+                best_p.push_back(p);
+            }
+            else {
+                variants[it->second] = std::move(v);
+                best_p[it->second]   = p;
+            }
+        }
+    }
+
+    /**
+     * Scores a cohort. Samples are split into chunks scored in parallel; within a chunk the weights are walked in
+     * blocks that stay in L1 cache, and every block is applied to a tile of samples at once with AVX2 fused multiply
+     * adds when the target has them. Dosages are summed in single precision within a block and in double across
+     * blocks.
+     * @param cohort dosages with one column per entry of variants
+     * @param threads the most threads to use, 0 for one per hardware thread
+     * @return the score of every sample
+     */
+    [[nodiscard]] std::vector<double> score(const DosageMatrix& cohort, unsigned threads = 0) const
+    {
+        if(cohort.n_variants != variants.size())
+            throw std::runtime_error("dosage matrix has " + std::to_string(cohort.n_variants) + " variants, score has "
+                                     + std::to_string(variants.size()));
+
+        std::vector<float> weights;
+        weights.reserve(variants.size());
+        for(auto& v : variants)
+            weights.push_back(static_cast<float>(v.weight));
+
+        std::vector<double> scores(cohort.n_samples, 0.0);
+        auto n_chunks = (cohort.n_samples + sample_chunk - 1) / sample_chunk;
+        parallel_for(n_chunks, [&](std::size_t c){
+            auto first = c * sample_chunk;
+            auto last  = std::min(first + sample_chunk, cohort.n_samples);
+            for(std::size_t begin{0}; begin < weights.size(); begin += variant_block) {
+                auto end = std::min(begin + variant_block, weights.size());
+                for(auto s = first; s < last; s += sample_tile) {
+                    auto n = std::min(sample_tile, last - s);
+                    const float* rows[sample_tile];
+                    for(std::size_t k{0}; k < n; k++)
+                        rows[k] = cohort.sample(s + k);
+                    score_tile(rows, n, weights.data(), begin, end, scores.data() + s);
+                }
+            }
+        }, threads);
+        return scores;
+    }
+};
+
+/**
+ * Finds the variants of a score in a genotype file: by rsID, or failing that by chromosome and position. One site can
+ * be several variants of the score, one per risk allele, so a lookup gives every one of them. The views point into the
+ * score, which must outlive the lookup.
+ */
+struct VariantLookup{
+
+    using Columns = std::vector<std::size_t>; // indices in score.variants, in increasing order
+
+    std::unordered_map<std::string_view, Columns>                                    by_rsid;
+    std::unordered_map<std::string_view, std::unordered_map<std::uint64_t, Columns>> by_locus;
+
+    explicit VariantLookup(const PolygenicScore& score) {
+        for(std::size_t v{0}; v < score.variants.size(); v++) {
+            auto& variant = score.variants[v];
+            by_rsid[variant.rsid].push_back(v);
+            if(variant.pos)
+                by_locus[variant.chr][variant.pos].push_back(v);
+        }
+    }
+
+    /**
+     * @param chr a chromosome, with or without a "chr" prefix
+     * @param pos a position, as text
+     * @param id an rsID
+     * @return the indices in score.variants of the variants at this site, empty if none are the score's
+     */
+    [[nodiscard]] std::span<const std::size_t> find(std::string_view chr, std::string_view pos, std::string_view id) const {
+        if(auto it = by_rsid.find(id); it != by_rsid.end())
+            return it->second;
+        if(chr.starts_with("chr"))
+            chr.remove_prefix(3);
+        auto on_chr = by_locus.find(chr);
+        if(on_chr == by_locus.end())
+            return {};
+        auto p  = try_parse<std::uint64_t>(pos);
+        auto it = p ? on_chr->second.find(*p) : on_chr->second.end();
+        if(it == on_chr->second.end())
+            return {};
+        return it->second;
+    }
+};
+
+#endif //GEN_RISK2_POLYGENICSCORE_HXX
@@ -0,0 +1,163 @@
+#include <functional>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+#include "Bitmap.hxx"
+#include "GWAS.hxx"
+
+//
+// Selecting associations with predicates combined by AND, OR and NOT.
+//
+
+#ifndef GEN_RISK2_QUERY_HXX
+#define GEN_RISK2_QUERY_HXX
+
+/**
+ * A predicate over the rows of a GWAS, built from leaves (equality, IN-list, prefix, numeric range) joined with &, |
+ * and ~. Evaluating it turns every leaf into a Bitmap of the table rows it matches and combines those with the word
+ * level operations of Bitmap, so rows are only listed once, at the end:
+ *
+ *     auto q = Query::in("CHR_ID", {"6", "11"}) & Query::between<gwas_col::EffectSize>(1.5, 100)
+ *              & ~Query::prefix("DISEASE/TRAIT", "Type 1");
+ *     auto hits = select(gwas, q);
+ *
+ * The right side of & is only evaluated on the rows the left side kept, so put the most selective predicate first.
+ * Leaves on a column with an index (see GWAS::index) read their rows from the index instead of scanning.
+ */
+class Query{
+
+    // (view, rows still in play) -> the rows in play that match
+    using Eval = std::function<Bitmap(const FlatFile&, const Bitmap&)>;
+
+    Eval eval;
+
+    explicit Query(Eval e) : eval(std::move(e)){}
+
+    /**
+     * A leaf testing the text of every cell in play. An encoded column is tested once per dictionary entry and then
+     * scanned by code.
+     */
+    template<typename Match>
+    static Query cell_test(std::string col_nm, Match match) {
+        return Query([col_nm = std::move(col_nm), match](const FlatFile& file, const Bitmap& in_play){
+            auto& col = file.column(file.index_of.at(col_nm));
+            Bitmap out;
+            if(col.encoded()) {
+                auto& dict = col.dict();
+                std::vector<bool> wanted(dict.size());
+                for(std::size_t code{0}; code < dict.size(); code++)
+                    wanted[code] = match(dict.values[code]);
+                auto codes = col.code_values();
+                in_play.for_each([&](std::size_t r){ if(wanted[codes[r]]) out.add(r); });
+            }
+            else
+                in_play.for_each([&](std::size_t r){ if(match(col[r])) out.add(r); });
+            return out;
+        });
+    }
+
+public:
+
+    /**
+     * @return the table rows of a view that match, in increasing order
+     */
+    [[nodiscard]] Bitmap evaluate(const FlatFile& file) const {
+        return eval(file, file.is_whole_table() ? Bitmap::all(file.num_rows()) : Bitmap(file.rows()));
+    }
+
+    /**
+     * @param col_nm a column
+     * @param values the values to accept
+     * @return a predicate matching the rows holding any of values in col_nm
+     */
+    static Query in(std::string col_nm, std::vector<std::string> values) {
+        auto owned = std::make_shared<const std::vector<std::string>>(std::move(values));
+        auto scan  = cell_test(col_nm, [owned, set = std::unordered_set<std::string_view>(owned->begin(), owned->end())](std::string_view v){
+            return set.contains(v);
+        });
+        return Query([col_nm = std::move(col_nm), owned, scan](const FlatFile& file, const Bitmap& in_play){
+            auto idx = file.find_index(file.index_of.at(col_nm));
+            if(!idx)
+                return scan.eval(file, in_play);
+            Bitmap out;
+            for(auto& v : *owned)
+                if(auto rows = idx->find(v))
+                    out = out | Bitmap(*rows);
+            return out & in_play;
+        });
+    }
+
+    /**
+     * @return a predicate matching the rows holding value in col_nm
+     */
+    static Query equals(std::string col_nm, std::string value) {
+        return in(std::move(col_nm), {std::move(value)});
+    }
+
+    /**
+     * @return a predicate matching the rows whose value in col_nm starts with prefix
+     */
+    static Query prefix(std::string col_nm, std::string prefix) {
+        return cell_test(std::move(col_nm), [prefix = std::move(prefix)](std::string_view v){ return v.starts_with(prefix); });
+    }
+
+    /**
+     * Rows whose parsed value lies in [lo, hi]. Rows that do not parse never match.
+     * @tparam T the type the column is parsed as; std::uint64_t and double use the cached parsed column when present
+     */
+    template<typename T>
+    static Query between(std::string col_nm, T lo, T hi) {
+        return Query([col_nm = std::move(col_nm), lo, hi](const FlatFile& file, const Bitmap& in_play){
+            auto read = file.numeric_reader<T>(file.index_of.at(col_nm));
+            Bitmap out;
+            in_play.for_each([&](std::size_t r){
+                if(auto v = read(r); v && lo <= *v && *v <= hi)
+                    out.add(r);
+            });
+            return out;
+        });
+    }
+
+    /**
+     * @tparam Col a column description, see gwas_col
+     */
+    template<typename Col>
+    static Query between(typename Col::type lo, typename Col::type hi) {
+        return between<typename Col::type>(Col::name, lo, hi);
+    }
+
+    friend Query operator&(Query a, Query b) {
+        return Query([a = std::move(a), b = std::move(b)](const FlatFile& file, const Bitmap& in_play){
+            auto left = a.eval(file, in_play);
+            return left.empty() ? left : b.eval(file, left);
+        });
+    }
+
+    friend Query operator|(Query a, Query b) {
+        return Query([a = std::move(a), b = std::move(b)](const FlatFile& file, const Bitmap& in_play){
+            return a.eval(file, in_play) | b.eval(file, in_play);
+        });
+    }
+
+    friend Query operator~(Query a) {
+        return Query([a = std::move(a)](const FlatFile& file, const Bitmap& in_play){
+            return in_play - a.eval(file, in_play);
+        });
+    }
+};
+
+/**
+ * @param gwas the associations to select from
+ * @param query the predicate they must match
+ * @return a view of the matching associations, in table order
+ */
+inline GWAS select(const GWAS& gwas, const Query& query)
+{
+    return GWAS(gwas.file.subset_rows(query.evaluate(gwas.file).rows()));
+}
+
+#endif //GEN_RISK2_QUERY_HXX
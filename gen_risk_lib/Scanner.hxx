@@ -0,0 +1,93 @@
+#include <bit>
+#include <cstdint>
+#include <string_view>
+
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+//
+// Vectorized search for the delimiters of tab separated text.
+//
+
+#ifndef GEN_RISK2_SCANNER_HXX
+#define GEN_RISK2_SCANNER_HXX
+
+/**
+ * Calls on_delim with the position of every tab and newline in a text, in increasing order. The text is compared 32
+ * (AVX2) or 16 (SSE2) bytes at a time and the matches of a block are read off a bit mask, so the cost is dominated by
+ * the number of delimiters rather than the number of bytes. Targets without either fall back to a byte loop.
+ * @param text the text to scan
+ * @param on_delim called with the offset of each delimiter in text
+ */
+template<typename OnDelim>
+void scan_delimiters(std::string_view text, OnDelim on_delim){
+    const char* p = text.data();
+    const std::size_t n = text.size();
+    std::size_t i{0};
+
+#if defined(__AVX2__)
+    const __m256i tab = _mm256_set1_epi8('\t');
+    const __m256i nl  = _mm256_set1_epi8('\n');
+    for(; i + 32 <= n; i += 32) {
+        __m256i block = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p + i));
+        auto mask = static_cast<std::uint32_t>(_mm256_movemask_epi8(
+                _mm256_or_si256(_mm256_cmpeq_epi8(block, tab), _mm256_cmpeq_epi8(block, nl))));
+        for(; mask; mask &= mask - 1)
+            on_delim(i + static_cast<std::size_t>(std::countr_zero(mask)));
+    }
+#elif defined(__SSE2__)
+    const __m128i tab = _mm_set1_epi8('\t');
+    const __m128i nl  = _mm_set1_epi8('\n');
+    for(; i + 16 <= n; i += 16) {
+        __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + i));
+        auto mask = static_cast<std::uint32_t>(_mm_movemask_epi8(
+                _mm_or_si128(_mm_cmpeq_epi8(block, tab), _mm_cmpeq_epi8(block, nl))));
+        for(; mask; mask &= mask - 1)
+            on_delim(i + static_cast<std::size_t>(std::countr_zero(mask)));
+    }
+#endif
+
+    for(; i < n; i++)
+        if(p[i] == '\t' || p[i] == '\n')
+            on_delim(i);
+}
+
+/**
+ * Splits tab separated text into cells with scan_delimiters. Empty lines are skipped and a carriage return ending a
+ * line is dropped, matching for_each_line.
+ * @param text the text to split, made of whole lines
+ * @param on_cell called with the column number and value of every cell, line by line
+ * @param on_row_end called after the last cell of every non-empty line
+ */
+template<typename OnCell, typename OnRowEnd>
+void for_each_cell(std::string_view text, OnCell on_cell, OnRowEnd on_row_end){
+    std::size_t start{0}; // first byte of the current cell
+    std::size_t col  {0}; // column of the current cell
+
+    auto end_line = [&](std::size_t end){
+        auto last = text.substr(start, end - start);
+        if(!last.empty() && last.back() == '\r')
+            last.remove_suffix(1);
+        if(col == 0 && last.empty())
+            return; // empty line
+        on_cell(col, last);
+        on_row_end();
+    };
+
+    scan_delimiters(text, [&](std::size_t pos){
+        if(text[pos] == '\t') {
+            on_cell(col++, text.substr(start, pos - start));
+        }
+        else {
+            end_line(pos);
+            col = 0;
+        }
+        start = pos + 1;
+    });
+
+    if(start < text.size() || col > 0)
+        end_line(text.size()); // last line without a newline, which may end in an empty cell
+}
+
+#endif //GEN_RISK2_SCANNER_HXX
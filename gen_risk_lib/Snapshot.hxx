@@ -0,0 +1,173 @@
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <type_traits>
+
+#include <sys/stat.h>
+#include <unistd.h>
+
+//
+// Building blocks of the binary snapshot format written and read by FlatFile.
+//
+
+#ifndef GEN_RISK2_SNAPSHOT_HXX
+#define GEN_RISK2_SNAPSHOT_HXX
+
+/**
+ * Identifies the exact contents of a source file a snapshot was built from: its size, its modification time, and a
+ * FNV-1a hash of its first and last 64 KiB plus 64 blocks of 4 KiB spread evenly in between. The hash only reads a
+ * few hundred KiB, so checking a stamp costs about the same for any file size.
+ */
+struct SourceStamp{
+
+    std::uint64_t size    {0};
+    std::int64_t  mtime_ns{0};
+    std::uint64_t hash    {0};
+
+    /**
+     * @param file the path to the file
+     * @return the stamp of the file as it is now
+     */
+    static SourceStamp of(const std::string& file){
+        struct stat st{};
+        if(::stat(file.c_str(), &st) != 0)
+            throw std::runtime_error("could not stat " + file);
+
+        SourceStamp stamp;
+        stamp.size     = static_cast<std::uint64_t>(st.st_size);
+        stamp.mtime_ns = static_cast<std::int64_t>(st.st_mtim.tv_sec) * 1'000'000'000 + st.st_mtim.tv_nsec;
+
+        std::ifstream in(file, std::ios::binary);
+        std::uint64_t h{14695981039346656037ull};
+        std::string block;
+        auto hash_block = [&](std::uint64_t offset, std::uint64_t len){
+            len = std::min(len, stamp.size - std::min(offset, stamp.size));
+            block.resize(len);
+            in.seekg(static_cast<std::streamoff>(offset));
+            in.read(block.data(), static_cast<std::streamsize>(len));
+            for(unsigned char c : block)
+                h = (h ^ c) * 1099511628211ull;
+        };
+        constexpr std::uint64_t edge{64 * 1024}, inner{4 * 1024}, n_inner{64};
+        hash_block(0, edge);
+        for(std::uint64_t i{1}; i <= n_inner; i++)
+            hash_block(stamp.size / (n_inner + 1) * i, inner);
+        hash_block(stamp.size > edge ? stamp.size - edge : 0, edge);
+        stamp.hash = h;
+
+        return stamp;
+    }
+
+    bool operator==(const SourceStamp&) const = default;
+};
+
+/**
+ * Sequential writer of a snapshot file. Arrays are padded to 8 byte boundaries so that a reader can use them in place
+ * from a memory mapping of the file.
+ */
+class SnapshotWriter{
+
+    std::ofstream out;
+    std::uint64_t offset{0};
+
+public:
+
+    explicit SnapshotWriter(const std::string& file) : out(file, std::ios::binary | std::ios::trunc){
+        if(!out)
+            throw std::runtime_error("could not create " + file);
+    }
+
+    void bytes(const void* data, std::size_t len){
+        out.write(static_cast<const char*>(data), static_cast<std::streamsize>(len));
+        offset += len;
+    }
+
+    template<typename T> requires std::is_trivially_copyable_v<T>
+    void value(const T& v){ bytes(&v, sizeof(T)); }
+
+    /**
+     * Writes the element count, padding, then the elements of an array.
+     */
+    template<typename T> requires std::is_trivially_copyable_v<T>
+    void array(std::span<const T> values){
+        value<std::uint64_t>(values.size());
+        align();
+        bytes(values.data(), values.size_bytes());
+    }
+
+    void string(std::string_view v){
+        value<std::uint64_t>(v.size());
+        bytes(v.data(), v.size());
+    }
+
+    void align(){
+        static constexpr char zeros[8]{};
+        bytes(zeros, (8 - offset % 8) % 8);
+    }
+
+    /**
+     * Flushes the file, throwing if anything could not be written.
+     */
+    void finish(){
+        out.flush();
+        if(!out)
+            throw std::runtime_error("could not write snapshot");
+    }
+};
+
+/**
+ * Sequential reader over the bytes of a snapshot, mirroring SnapshotWriter. Arrays and strings are returned as views
+ * into the bytes. Reading past the end throws std::runtime_error, so a truncated file is rejected rather than misread.
+ */
+class SnapshotReader{
+
+    std::string_view data;
+    std::size_t      offset{0};
+
+    void need(std::size_t len) const {
+        if(len > data.size() - offset)
+            throw std::runtime_error("truncated snapshot");
+    }
+
+public:
+
+    explicit SnapshotReader(std::string_view a_data) : data(a_data){}
+
+    std::string_view bytes(std::size_t len){
+        need(len);
+        auto v = data.substr(offset, len);
+        offset += len;
+        return v;
+    }
+
+    template<typename T> requires std::is_trivially_copyable_v<T>
+    T value(){
+        T v;
+        std::memcpy(&v, bytes(sizeof(T)).data(), sizeof(T));
+        return v;
+    }
+
+    template<typename T> requires std::is_trivially_copyable_v<T>
+    std::span<const T> array(){
+        auto n = value<std::uint64_t>();
+        align();
+        if(n > (data.size() - offset) / sizeof(T))
+            throw std::runtime_error("truncated snapshot");
+        auto raw = bytes(n * sizeof(T));
+        return {reinterpret_cast<const T*>(raw.data()), static_cast<std::size_t>(n)};
+    }
+
+    std::string_view string(){
+        return bytes(value<std::uint64_t>());
+    }
+
+    void align(){
+        bytes((8 - offset % 8) % 8);
+    }
+};
+
+#endif //GEN_RISK2_SNAPSHOT_HXX
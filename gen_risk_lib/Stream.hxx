@@ -0,0 +1,153 @@
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "GWAS.hxx"
+#include "Scanner.hxx"
+
+//
+// Reading a tab separated file one chunk at a time, for files that do not fit in memory.
+//
+
+#ifndef GEN_RISK2_STREAM_HXX
+#define GEN_RISK2_STREAM_HXX
+
+/**
+ * A tab separated file with a header whose rows are pushed through a callback instead of being stored. The file is
+ * read through one buffer of chunk_bytes, so memory use stays bounded by the chunk size (plus the longest line, since
+ * the buffer grows to hold a line longer than itself) however large the file is. Nothing passed to a callback outlives
+ * the call: copy out whatever has to be kept.
+ *
+ * Keeping the rows of one disease and two of their columns:
+ *
+ *     RowStream stream(file);
+ *     auto disease = stream.index_of.at("DISEASE/TRAIT");
+ *     stream.for_each({"CHR_POS", "OR or BETA"},
+ *                     [&](const auto& cells){ return cells[disease] == "Type 2 diabetes"; },
+ *                     [&](const auto& projected){ ... });
+ */
+class RowStream{
+
+    std::string              path;
+    std::size_t              chunk_bytes;
+    std::vector<std::string> header_;
+    std::streamoff           body_offset{0}; // where the line after the header starts
+
+    /**
+     * Reads the file after the header chunk by chunk and passes on the whole lines of every chunk. A line cut by the
+     * end of a chunk is carried over to the start of the next one.
+     * @param on_text called with text made of whole lines, in file order
+     */
+    template<typename OnText>
+    void for_each_chunk(OnText on_text) const
+    {
+        std::ifstream in(path, std::ios::binary);
+        if(!in)
+            throw std::runtime_error("could not open " + path);
+        in.seekg(body_offset);
+
+        std::vector<char> buffer(chunk_bytes);
+        std::size_t held{0}; // bytes at the start of buffer not passed on yet
+        while(true) {
+            if(held == buffer.size())
+                buffer.resize(buffer.size() * 2); // no newline in a whole buffer: the line is longer than a chunk
+            in.read(buffer.data() + held, static_cast<std::streamsize>(buffer.size() - held));
+            auto got = static_cast<std::size_t>(in.gcount());
+            held += got;
+
+            std::string_view text(buffer.data(), held);
+            if(got == 0) {
+                if(!text.empty())
+                    on_text(text); // last line without a newline
+                return;
+            }
+
+            auto last = text.rfind('\n');
+            if(last == std::string_view::npos)
+                continue;
+            on_text(text.substr(0, last + 1));
+            held = text.size() - last - 1;
+            std::memmove(buffer.data(), buffer.data() + last + 1, held);
+        }
+    }
+
+public:
+
+    ColumnIndex index_of;
+
+    /**
+     * Opens a file and reads its header. The rows are only read by for_each.
+     * @param file the path of a tab separated file with a header line
+     * @param chunk_bytes the size of the read buffer
+     */
+    explicit RowStream(std::string file, std::size_t chunk_bytes = std::size_t{1} << 20)
+        : path(std::move(file)), chunk_bytes(std::max<std::size_t>(chunk_bytes, 1))
+    {
+        std::ifstream in(path, std::ios::binary);
+        if(!in)
+            throw std::runtime_error("could not open " + path);
+
+        std::string line;
+        std::getline(in, line);
+        if(!line.empty() && line.back() == '\r')
+            line.pop_back();
+        for_each_token(line, [this](std::string_view token){ header_.emplace_back(token); });
+        body_offset = in.eof() ? std::streamoff{-1} : static_cast<std::streamoff>(in.tellg());
+        index_of = ColumnIndex(header_);
+    }
+
+    [[nodiscard]] auto header() const -> const std::vector<std::string>& { return header_; }
+
+    /**
+     * Calls on_row with the cells of every row, in file order. Cells missing from a short row are empty and cells past
+     * the header are dropped, so the cells are always as many as the header.
+     * @param on_row called with a const std::vector<std::string_view>& indexed like the header
+     */
+    template<typename OnRow>
+    void for_each(OnRow on_row) const
+    {
+        if(body_offset < 0)
+            return; // nothing after the header
+        std::vector<std::string_view> cells(header_.size());
+        for_each_chunk([&](std::string_view text){
+            for_each_cell(text,
+                          [&](std::size_t col, std::string_view cell){
+                              if(col < cells.size())
+                                  cells[col] = cell;
+                          },
+                          [&]{
+                              on_row(static_cast<const std::vector<std::string_view>&>(cells));
+                              std::fill(cells.begin(), cells.end(), std::string_view{});
+                          });
+        });
+    }
+
+    /**
+     * Filters and projects the rows of the file: on_row gets the chosen columns of every row that keep accepts.
+     * @param columns the names of the columns to pass on, in the order wanted
+     * @param keep called with all the cells of a row (see for_each), returns whether to pass the row on
+     * @param on_row called with a const std::vector<std::string_view>& holding the cells of columns, in that order
+     */
+    template<typename Keep, typename OnRow>
+    void for_each(const std::vector<std::string>& columns, Keep keep, OnRow on_row) const
+    {
+        std::vector<std::size_t> cols;
+        for(auto& col_nm : columns)
+            cols.push_back(index_of.at(col_nm));
+
+        std::vector<std::string_view> projected(cols.size());
+        for_each([&](const std::vector<std::string_view>& cells){
+            if(!keep(cells))
+                return;
+            for(std::size_t i{0}; i < cols.size(); i++)
+                projected[i] = cells[cols[i]];
+            on_row(static_cast<const std::vector<std::string_view>&>(projected));
+        });
+    }
+};
+
+#endif //GEN_RISK2_STREAM_HXX
@@ -0,0 +1,317 @@
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include <zlib.h>
+
+#include "GWAS.hxx"
+#include "Parallel.hxx"
+#include "PolygenicScore.hxx"
+
+//
+// Reading the genotypes of a score's variants from a VCF file.
+//
+
+#ifndef GEN_RISK2_VCFREADER_HXX
+#define GEN_RISK2_VCFREADER_HXX
+
+/**
+ * A VCF file, plain or gzip/bgzip compressed, read as a stream. Only the records of the variants of a PolygenicScore
+ * are decoded: a record is looked up by its ID, or failing that by CHROM and POS, and every other record is dropped
+ * after those three fields. The records that match are turned into risk allele dosages written straight into a
+ * DosageMatrix, without building any per-record strings.
+ *
+ * Reading is pipelined: one thread decompresses the file into buffers of whole lines while the other threads parse
+ * the buffers it has finished. At most two buffers per parsing thread are in flight, so memory stays bounded by the
+ * buffer size however large the file is.
+ */
+class VcfReader{
+
+    std::string              path;
+    std::size_t              chunk_bytes;
+    std::vector<std::string> samples_;
+    std::vector<bool>        matched_;
+
+    static constexpr auto npos = std::string_view::npos;
+
+    /**
+     * Decompresses the file and passes it on in buffers of whole lines. A line cut by the end of a buffer is carried
+     * over to the next one, and a line longer than a buffer makes the buffer grow.
+     * @param on_text called with every buffer, in file order; returns false to stop reading
+     */
+    template<typename OnText>
+    void for_each_chunk(OnText on_text) const
+    {
+        std::unique_ptr<gzFile_s, decltype(&gzclose)> in(gzopen(path.c_str(), "rb"), &gzclose);
+        if(!in)
+            throw std::runtime_error("could not open " + path);
+
+        std::string carry;
+        while(true) {
+            std::string buffer = std::move(carry);
+            auto held = buffer.size();
+            buffer.resize(std::max(chunk_bytes, held * 2));
+            auto got = gzread(in.get(), buffer.data() + held, static_cast<unsigned>(buffer.size() - held));
+            if(got < 0)
+                throw std::runtime_error("could not decompress " + path);
+            buffer.resize(held + static_cast<std::size_t>(got));
+
+            if(got == 0) {
+                if(!buffer.empty())
+                    on_text(std::move(buffer)); // last line without a newline
+                return;
+            }
+
+            auto last = buffer.rfind('\n');
+            carry = last == npos ? std::move(buffer) : buffer.substr(last + 1);
+            if(last == npos)
+                continue;
+            buffer.resize(last + 1);
+            if(!on_text(std::move(buffer)))
+                return;
+        }
+    }
+
+    /**
+     * @param cell the cell of one sample, e.g. "0|1:0.98"
+     * @param field the index of the wanted ':' separated field
+     * @return that field, empty if the cell has fewer
+     */
+    static std::string_view sub_field(std::string_view cell, std::size_t field) {
+        for(; field > 0; field--) {
+            auto colon = cell.find(':');
+            if(colon == npos)
+                return {};
+            cell.remove_prefix(colon + 1);
+        }
+        return cell.substr(0, cell.find(':'));
+    }
+
+    /**
+     * @param gt a genotype such as "0/1", "1|1", "2" or "./."
+     * @param allele the index of an allele, 0 for REF
+     * @return how many copies of the allele the genotype carries; missing calls carry none
+     */
+    static float allele_count(std::string_view gt, std::size_t allele) {
+        float n{0};
+        while(!gt.empty()) {
+            auto end = gt.find_first_of("/|");
+            if(try_parse<std::size_t>(gt.substr(0, end)) == allele)
+                n++;
+            gt.remove_prefix(end == npos ? gt.size() : end + 1);
+        }
+        return n;
+    }
+
+    /**
+     * Decodes one record into the columns of out of every score variant at this site whose risk allele it names; the
+     * same site can be weighted for several alleles, e.g. by different traits. Dosages come from DS on biallelic
+     * records that have it and from GT otherwise.
+     * @param claimed set for every variant already decoded; later records of the same variant are dropped
+     */
+    void parse_record(std::string_view line, const PolygenicScore& score, const VariantLookup& lookup, DosageMatrix& out,
+                      std::vector<std::atomic<bool>>& claimed) const
+    {
+        auto rest = line;
+        auto next = [&rest](){
+            auto tab   = rest.find('\t');
+            auto field = rest.substr(0, tab);
+            rest.remove_prefix(tab == npos ? rest.size() : tab + 1);
+            return field;
+        };
+
+        auto chr = next();
+        auto pos = next();
+        auto id  = next();
+        auto columns = lookup.find(chr, pos, id);
+        if(columns.empty())
+            return;
+
+        auto ref = next();
+        auto alt = next();
+        next(); // QUAL
+        next(); // FILTER
+        next(); // INFO
+        auto format = next();
+
+        std::optional<std::size_t> gt, ds; // positions of GT and DS in FORMAT
+        std::size_t k{0};
+        for(auto keys = format; !keys.empty(); k++) {
+            auto colon = keys.find(':');
+            auto key   = keys.substr(0, colon);
+            if(key == "GT")
+                gt = k;
+            else if(key == "DS")
+                ds = k;
+            keys.remove_prefix(colon == npos ? keys.size() : colon + 1);
+        }
+        bool use_ds = ds && alt.find(',') == npos; // DS counts the only ALT allele
+        if(!use_ds && !gt)
+            return;
+
+        // (column, index of its risk allele, 0 for REF) of every variant this record fills
+        std::vector<std::pair<std::size_t, std::size_t>> targets;
+        for(auto v : columns) {
+            auto& risk = score.variants[v].allele;
+            std::optional<std::size_t> allele;
+            if(ref == risk)
+                allele = 0;
+            std::size_t i{1};
+            for(auto alts = alt; !allele && !alts.empty(); i++) {
+                auto comma = alts.find(',');
+                if(alts.substr(0, comma) == risk)
+                    allele = i;
+                alts.remove_prefix(comma == npos ? alts.size() : comma + 1);
+            }
+            if(allele && !claimed[v].exchange(true))
+                targets.emplace_back(v, *allele);
+        }
+
+        for(std::size_t s{0}; !targets.empty() && s < out.n_samples; s++) {
+            auto cell = next();
+            std::optional<double> alt_dosage;
+            if(use_ds)
+                alt_dosage = try_parse<double>(sub_field(cell, *ds));
+            for(auto [v, allele] : targets) {
+                float dosage{0};
+                if(use_ds) {
+                    if(alt_dosage)
+                        dosage = static_cast<float>(allele == 0 ? 2 - *alt_dosage : *alt_dosage);
+                }
+                else
+                    dosage = allele_count(sub_field(cell, *gt), allele);
+                out.sample(s)[v] = dosage;
+            }
+        }
+    }
+
+public:
+
+    /**
+     * Opens a VCF file and reads the sample names from its #CHROM line.
+     * @param file the path of a .vcf or .vcf.gz file
+     * @param chunk_bytes the size of the decompressed buffers handed to the parsing threads
+     */
+    explicit VcfReader(std::string file, std::size_t chunk_bytes = std::size_t{1} << 22)
+        : path(std::move(file)), chunk_bytes(std::max<std::size_t>(chunk_bytes, 1))
+    {
+        bool found{false};
+        for_each_chunk([&](std::string&& text){
+            for_each_line(text, [&](std::string_view line){
+                if(found || !line.starts_with("#CHROM"))
+                    return;
+                found = true;
+                std::size_t col{0};
+                for_each_token(line, [&](std::string_view name){
+                    if(col++ >= 9)
+                        samples_.emplace_back(name);
+                });
+            });
+            return !found && text.starts_with("#"); // the header ends before the first record
+        });
+        if(!found)
+            throw std::runtime_error("no #CHROM line in " + path);
+    }
+
+    [[nodiscard]] auto samples() const -> const std::vector<std::string>& { return samples_; }
+
+    /**
+     * @return for every variant of the score last read, whether the file had it
+     */
+    [[nodiscard]] auto matched() const -> const std::vector<bool>& { return matched_; }
+
+    /**
+     * Reads the dosages of a score's variants. Variants the file lacks, or whose record has no allele equal to the
+     * score's risk allele, keep dosage 0, as do missing calls; see matched().
+     * @param score the variants to read
+     * @param threads the threads to use, one of them for decompression; 0 for one per hardware thread
+     * @return the dosages, one row per sample and one column per variant of score
+     */
+    DosageMatrix read(const PolygenicScore& score, unsigned threads = 0)
+    {
+        VariantLookup lookup(score);
+        DosageMatrix out(samples_.size(), score.variants.size());
+        std::vector<std::atomic<bool>> claimed(score.variants.size());
+
+        unsigned parsers = std::max(1u, (threads ? threads : default_threads()) - 1);
+
+        std::mutex              mtx;
+        std::condition_variable cv;
+        std::deque<std::string> ready;        // decompressed buffers waiting for a parser
+        bool                    done{false};  // the decompressing thread has finished
+        bool                    stop{false};  // a parser failed, so nothing more is needed
+        std::exception_ptr      read_error;
+
+        std::jthread decompress([&](){
+            try {
+                for_each_chunk([&](std::string&& text){
+                    std::unique_lock lock(mtx);
+                    cv.wait(lock, [&](){ return ready.size() < 2 * parsers || stop; });
+                    if(stop)
+                        return false;
+                    ready.push_back(std::move(text));
+                    cv.notify_all();
+                    return true;
+                });
+            }
+            catch(...) {
+                read_error = std::current_exception();
+            }
+            std::lock_guard lock(mtx);
+            done = true;
+            cv.notify_all();
+        });
+
+        try {
+            parallel_for(parsers, [&](std::size_t){
+                while(true) {
+                    std::string text;
+                    {
+                        std::unique_lock lock(mtx);
+                        cv.wait(lock, [&](){ return !ready.empty() || done; });
+                        if(ready.empty())
+                            return;
+                        text = std::move(ready.front());
+                        ready.pop_front();
+                        cv.notify_all();
+                    }
+                    for_each_line(text, [&](std::string_view line){
+                        if(line.front() != '#')
+                            parse_record(line, score, lookup, out, claimed);
+                    });
+                }
+            }, parsers);
+        }
+        catch(...) {
+            {
+                std::lock_guard lock(mtx);
+                stop = true;
+                cv.notify_all();
+            }
+            decompress.join();
+            throw;
+        }
+        decompress.join();
+        if(read_error)
+            std::rethrow_exception(read_error);
+
+        matched_.assign(claimed.size(), false);
+        for(std::size_t v{0}; v < claimed.size(); v++)
+            matched_[v] = claimed[v];
+        return out;
+    }
+};
+
+#endif //GEN_RISK2_VCFREADER_HXX
@@ -1,9 +1,13 @@
+#include <algorithm>
 #include <iostream>
 #include <random>
 #include <fstream>
-#include <set>
 
+#include "Colocation.hxx"
+#include "DensityScan.hxx"
 #include "GWAS.hxx"
+#include "PolygenicScore.hxx"
+#include "Query.hxx"
 
 //enum Allele {A,G,T,C};
 //std::unordered_map<int, Allele> get_allele = {{0, A}, {1, G}, {2, T}, {3, C}};
@@ -11,16 +15,24 @@
 //@todo add google unit tests
 int main() {
 
-    auto gwas = GWAS("gwas_catalog_v1.0-associations_e100_r2021-02-25.tsv");
+    auto options = GWAS::catalogOptions();
+    options.snapshot = "gwas_catalog_v1.0-associations_e100_r2021-02-25.snapshot"; // reused by every later run until the TSV changes
+    auto gwas = GWAS("gwas_catalog_v1.0-associations_e100_r2021-02-25.tsv", options);
 
     gwas.printSummary();
 
+    gwas.index("DISEASE/TRAIT");
+    gwas.index("CHR_ID");
+
     auto t2d = gwas.subsetter("DISEASE/TRAIT","Type 2 diabetes");
 
     t2d.printSummary();
-    std::cout << "Unique RSIDs for t2d: " << t2d.uniqueRSIDs().size() << std::endl;
+    std::cout << "Unique RSIDs for t2d: " << t2d.numUniqueRSIDs() << std::endl;
+
+    PolygenicScore t2d_score(t2d);
+    std::cout << "t2d risk score variants: " << t2d_score.variants.size() << std::endl;
 
-    auto t2d6 = t2d.subsetter("CHR_ID","6");
+    auto t2d6 = select(gwas, Query::equals("DISEASE/TRAIT", "Type 2 diabetes") & Query::equals("CHR_ID", "6"));
 
     t2d6.printSummary();
     auto pos = t2d6.positions_and_effect_size();
@@ -33,30 +45,51 @@ int main() {
         std::cout << p.second << ",";
     std::cout << std::endl;
 
+    auto mhc = gwas.region("6", 28'000'000, 34'000'000);
+    std::cout << "MHC associations: " << mhc.size() << std::endl;
+
+    // regions holding more associations than chance allows, there may be other MHC-type regions
+    for(auto& w : density_scan(gwas))
+        if(w.p_value < 0.01)
+            std::cout << "enriched " << w.chr << ":" << w.start << "-" << w.end << " " << w.count
+                      << " associations (expected " << w.expected << ", p " << w.p_value << ")" << std::endl;
+
+    // different odds ratios at the exact same position, and whether they have the same risk allele
+    auto loci = colocated_loci(gwas);
+    auto conflicts = std::count_if(loci.begin(), loci.end(), [](const Locus& l){ return l.allele_conflict(); });
+    std::cout << "shared positions: " << loci.size() << ", with disagreeing risk alleles: " << conflicts << std::endl;
+    if(auto widest = std::max_element(loci.begin(), loci.end(), [](const Locus& a, const Locus& b){ return a.spread() < b.spread(); });
+       widest != loci.end())
+        std::cout << "widest effect spread " << widest->chr << ":" << widest->pos << " " << widest->min_effect << " to "
+                  << widest->max_effect << " over " << widest->rows.size() << " associations" << std::endl;
+
     std::ofstream myfile;
     myfile.open ("adis.csv");
 
-    //@todo investigate different odds ratios at the exact same position and also see if they have the same risk allele
-    //@todo see if some genome regions are have a higher prior to being associated with a disease, more than chance allows. there may be other MHC-type regions
-    for(auto& dis_nm : gwas.uniqueDiseases())
+    std::vector<std::string_view> chrs = {"1","2","3","4","5","6","7","8","9","10","11","12","13","14","15","16","17","18","19","20","21","22","X","Y"};
+    auto chr_rank = [&chrs](std::string_view chr){ return std::find(chrs.begin(), chrs.end(), chr) - chrs.begin(); };
+
+    // groups come in first-seen order; walk them by disease name, then in the order of chrs
+    auto groups = gwas.group_by("DISEASE/TRAIT", "CHR_ID");
+    std::erase_if(groups, [&](auto& g){ return chr_rank(g.first[1]) == std::ssize(chrs); });
+    std::sort(groups.begin(), groups.end(), [&](auto& a, auto& b){
+        return std::pair(a.first[0], chr_rank(a.first[1])) < std::pair(b.first[0], chr_rank(b.first[1]));
+    });
+    for(auto& [key, dischr] : groups)
     {
-        auto dis = gwas.subsetter("DISEASE/TRAIT", dis_nm);
-
-        std::vector<std::string> chrs = {"1","2","3","4","5","6","7","8","9","10","11","12","13","14","15","16","17","18","19","20","21","22","X","Y"};
-        for(auto& chr : chrs) {
-            auto dischr = dis.subsetter("CHR_ID",chr);
-            auto pos_ES = dischr.positions_and_effect_size();
-            if(!pos_ES.empty())
-                std::cout << dis_nm << ":" << chr << " size is " << pos_ES.size() << std::endl;
-
-            if (pos_ES.size() > 1546) {
-                for (auto &pes: pos_ES)
-                    if (pes.second < 1)
-                        myfile << pes.first << "," << pes.second << "," << std::endl;
-                return 1;
-            }
+        auto& dis_nm = key[0];
+        auto& chr    = key[1];
+
+        auto pos_ES = dischr.positions_and_effect_size();
+        if(!pos_ES.empty())
+            std::cout << dis_nm << ":" << chr << " size is " << pos_ES.size() << std::endl;
+
+        if (pos_ES.size() > 1546) {
+            for (auto &pes: pos_ES)
+                if (pes.second < 1)
+                    myfile << pes.first << "," << pes.second << "," << std::endl;
+            return 1;
         }
-
     }
 
     return 0;